@@ -0,0 +1,11 @@
+#!/bin/bash
+set -e
+
+reldir=`dirname $0`
+cd $reldir
+
+mkdir -p build-bench
+cd build-bench
+cmake -DCMAKE_BUILD_TYPE=Release ../bench/
+make -j
+./stupid-json-bench ../tests "$@"
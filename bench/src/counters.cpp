@@ -0,0 +1,148 @@
+#include "counters.hpp"
+
+#include <cstring>
+#include <sys/resource.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static uint64_t RusageFaults() {
+#ifdef RUSAGE_THREAD
+    const int who = RUSAGE_THREAD;
+#else
+    const int who = RUSAGE_SELF;
+#endif
+
+    struct rusage usage;
+    if (getrusage(who, &usage) != 0) {
+        return 0;
+    }
+
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+#ifdef __linux__
+static int OpenCounter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1; // Allowed with perf_event_paranoid up to 2
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return static_cast<int>(
+        syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+static uint64_t CacheMissConfig(uint64_t cache) {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+#endif
+
+Counters::Counters() {
+    for (int i = 0; i < Count; ++i) {
+        fds[i] = -1;
+        values[i] = 0;
+    }
+
+#ifdef __linux__
+    // Counters are opened one by one rather than as a group, so that a
+    // single unsupported event doesn't take the others down with it
+    fds[Cycles] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fds[Instructions] =
+        OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds[BranchMisses] =
+        OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    fds[L1DMisses] = OpenCounter(PERF_TYPE_HW_CACHE,
+                                 CacheMissConfig(PERF_COUNT_HW_CACHE_L1D));
+    fds[LLCMisses] = OpenCounter(PERF_TYPE_HW_CACHE,
+                                 CacheMissConfig(PERF_COUNT_HW_CACHE_LL));
+    fds[PageFaults] =
+        OpenCounter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+#endif
+}
+
+Counters::~Counters() {
+#ifdef __linux__
+    for (int fd : fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+void Counters::Start() {
+    faultsAtStart = RusageFaults();
+
+#ifdef __linux__
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void Counters::Stop() {
+#ifdef __linux__
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+
+    for (int i = 0; i < Count; ++i) {
+        uint64_t data[3]; // Value, time enabled, time running
+        if (fds[i] < 0 || read(fds[i], data, sizeof(data)) != sizeof(data)) {
+            values[i] = 0;
+            continue;
+        }
+
+        // Scale up if the PMU was multiplexed between more events than it
+        // has counters for
+        values[i] = data[2] ? static_cast<uint64_t>(
+                                  double(data[0]) * data[1] / data[2])
+                            : 0;
+    }
+#endif
+
+    if (fds[PageFaults] < 0) {
+        values[PageFaults] = RusageFaults() - faultsAtStart;
+    }
+}
+
+bool Counters::Available(Counter c) const {
+    return fds[c] >= 0 || c == PageFaults;
+}
+
+uint64_t Counters::Value(Counter c) const { return values[c]; }
+
+const char *Counters::Name(Counter c) {
+    switch (c) {
+    case Cycles:
+        return "cycles";
+    case Instructions:
+        return "instructions";
+    case BranchMisses:
+        return "branch_misses";
+    case L1DMisses:
+        return "l1d_misses";
+    case LLCMisses:
+        return "llc_misses";
+    case PageFaults:
+        return "page_faults";
+    default:
+        return "unknown";
+    }
+}
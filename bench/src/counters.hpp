@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * A set of hardware and software counters for the calling thread, read
+ * through perf_event_open on Linux. Counters that can't be opened, because
+ * of perf_event_paranoid, a missing PMU in a VM or another OS, are reported
+ * as unavailable. Page faults fall back to getrusage.
+ */
+class Counters {
+  public:
+    enum Counter {
+        Cycles = 0,
+        Instructions,
+        BranchMisses,
+        L1DMisses,
+        LLCMisses,
+        PageFaults,
+        Count,
+    };
+
+    Counters();
+    Counters(const Counters &) = delete;
+    ~Counters();
+
+    void Start();
+    void Stop();
+
+    bool Available(Counter c) const;
+    uint64_t Value(Counter c) const;
+
+    static const char *Name(Counter c);
+
+  private:
+    int fds[Count];
+    uint64_t values[Count];
+    uint64_t faultsAtStart = 0;
+};
@@ -0,0 +1,786 @@
+#include "counters.hpp"
+#include "stupid-json/arena.hpp"
+#include "stupid-json/binary.hpp"
+#include "stupid-json/containers.hpp"
+#include "stupid-json/format.hpp"
+#include "stupid-json/parallel.hpp"
+#include "stupid-json/sax.hpp"
+#include "stupid-json/scatter.hpp"
+#include "stupid-json/shape.hpp"
+#include "stupid-json/validate.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace StupidJSON;
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string path = "../tests";
+    std::string out;
+    std::string baseline;
+    double threshold = 5.0; // Percent slowdown that counts as a regression
+    double minTime = 0.5;   // Seconds spent on each measurement
+    bool counters = false;  // Also profile with hardware counters
+};
+
+struct Corpus {
+    std::string name;
+    std::string body;
+    std::vector<StringView> docs; // One per line for NDJSON
+};
+
+struct Result {
+    std::string corpus;
+    std::string op;
+    size_t iterations;
+    double nsPerIter;
+    double mbPerSec; // Only valid if hasBytes is set
+    bool hasBytes;
+    double nsPerNode;
+};
+
+struct Profile {
+    std::string corpus;
+    std::string phase;
+    size_t reps;
+    size_t nodes;
+    size_t bytes; // Size of the corpus, counts are reported per MB of it
+    bool available[Counters::Count];
+    uint64_t values[Counters::Count];
+};
+
+// Keeps the compiler from discarding the work being measured
+static volatile size_t sink;
+
+static std::string ReadFile(const std::string &name) {
+    std::ifstream s(name, std::ios::binary);
+    std::string body((std::istreambuf_iterator<char>(s)),
+                     std::istreambuf_iterator<char>());
+    return body;
+}
+
+static size_t CountNodes(Element *elem) {
+    size_t count = 1;
+    for (auto it = elem->firstChild; it != nullptr; it = it->next) {
+        count += CountNodes(it);
+    }
+
+    return count;
+}
+
+static bool ParseAll(const Corpus &corpus, ArenaAllocator &arena,
+                     std::vector<Element *> &roots,
+                     const ParseOptions &options = {}) {
+    roots.clear();
+
+    for (auto doc : corpus.docs) {
+        auto root = arena.CreateElement();
+        if (!root || !root->ParseBody(doc, arena, options)) {
+            return false;
+        }
+
+        roots.push_back(root);
+    }
+
+    return true;
+}
+
+static size_t IterateTree(Element *elem, ArenaAllocator &arena) {
+    size_t count = 1;
+
+    elem->IterateArray(
+        [&](auto, Element *child) { count += IterateTree(child, arena); });
+    elem->IterateObject(arena, [&](auto, Element *child) {
+        count += IterateTree(child, arena);
+    });
+
+    return count;
+}
+
+template <typename F> static void Walk(Element *elem, F &f) {
+    f(elem);
+
+    for (auto it = elem->firstChild; it != nullptr; it = it->next) {
+        Walk(it, f);
+    }
+}
+
+using Lookups = std::vector<std::pair<Element *, StringView>>;
+
+/**
+ * Every key of every object. The names are copied into storage, so that
+ * finding them compares bytes like a key from elsewhere would, instead of
+ * matching the tree's own views by address.
+ */
+static Lookups CollectLookups(const std::vector<Element *> &roots,
+                              ArenaAllocator &arena, std::string &storage) {
+    Lookups lookups;
+    auto collect = [&](Element *elem) {
+        elem->IterateObject(arena, [&](StringView key, Element *) {
+            lookups.emplace_back(elem, key);
+        });
+    };
+
+    for (auto root : roots) {
+        Walk(root, collect);
+    }
+
+    size_t size = 0;
+    for (auto &lookup : lookups) {
+        size += lookup.second.Size();
+    }
+
+    storage.clear();
+    storage.reserve(size);
+    for (auto &lookup : lookups) {
+        auto key = lookup.second;
+        lookup.second = {storage.data() + storage.size(), key.Size()};
+        storage.append(key.begin, key.Size());
+    }
+
+    return lookups;
+}
+
+static size_t FindAll(const Lookups &lookups, ArenaAllocator &arena) {
+    size_t found = 0;
+    for (auto &lookup : lookups) {
+        found +=
+            lookup.first->FindChildElement(lookup.second, arena) != nullptr;
+    }
+
+    return found;
+}
+
+/**
+ * Run op until minTime has passed, with setup excluded from the timing, and
+ * return the fastest iteration. Bytes is what one run reads or writes, or 0
+ * for ops whose cost does not follow the size of the text.
+ */
+static Result Measure(const Options &opts, const Corpus &corpus,
+                      const char *op, size_t nodes, size_t bytes,
+                      const std::function<void()> &setup,
+                      const std::function<void()> &run) {
+    double best = 1e30;
+    double spent = 0;
+    size_t iterations = 0;
+
+    while (spent < opts.minTime || iterations < 3) {
+        setup();
+
+        auto start = Clock::now();
+        run();
+        auto stop = Clock::now();
+
+        double ns = std::chrono::duration<double, std::nano>(stop - start)
+                        .count();
+        best = std::min(best, ns);
+        spent += ns * 1e-9;
+        iterations++;
+    }
+
+    Result res;
+    res.corpus = corpus.name;
+    res.op = op;
+    res.iterations = iterations;
+    res.nsPerIter = best;
+    res.mbPerSec = bytes / (best * 1e-9) / (1024.0 * 1024.0);
+    res.hasBytes = bytes != 0;
+    res.nsPerNode = nodes ? best / nodes : 0;
+    return res;
+}
+
+static bool BenchCorpus(const Options &opts, const Corpus &corpus,
+                        std::vector<Result> &results) {
+    ArenaAllocator arena;
+    std::vector<Element *> roots;
+
+    if (!ParseAll(corpus, arena, roots)) {
+        std::cerr << "Failed to parse " << corpus.name << std::endl;
+        return false;
+    }
+
+    size_t nodes = 0;
+    for (auto root : roots) {
+        nodes += CountNodes(root);
+    }
+
+    auto nop = [] {};
+    auto reparse = [&] {
+        arena.Reset();
+        ParseAll(corpus, arena, roots);
+    };
+
+    size_t size = corpus.body.size();
+    results.push_back(Measure(opts, corpus, "ParseBody", nodes, size,
+                              [&] { arena.Reset(); },
+                              [&] { ParseAll(corpus, arena, roots); }));
+
+    // The shape is kept between iterations, like it would be for a stream
+    Shape shape;
+    ParseOptions shapeOptions;
+    shapeOptions.shape = &shape;
+    results.push_back(
+        Measure(opts, corpus, "ParseShape", nodes, size, [&] { arena.Reset(); },
+                [&] { ParseAll(corpus, arena, roots, shapeOptions); }));
+
+    results.push_back(Measure(opts, corpus, "Reset", nodes, 0, reparse,
+                              [&] { arena.Reset(); }));
+
+    results.push_back(
+        Measure(opts, corpus, "ParseEvents", nodes, size, nop, [&] {
+            struct : SaxHandler {
+                size_t count = 0;
+                bool String(StringView) {
+                    count++;
+                    return true;
+                }
+                bool Number(StringView) {
+                    count++;
+                    return true;
+                }
+            } handler;
+
+            for (auto doc : corpus.docs) {
+                ParseEvents(doc, handler);
+            }
+            sink = handler.count;
+        }));
+
+    reparse();
+
+    // Collect the key names up front, so that only the lookups are measured
+    std::string keys;
+    auto lookups = CollectLookups(roots, arena, keys);
+
+    results.push_back(
+        Measure(opts, corpus, "FindChildElement", lookups.size(), 0, nop,
+                [&] { sink = FindAll(lookups, arena); }));
+
+    // Build a map of every object and look up each of its keys once, the
+    // lookups of an object are next to each other
+    ArenaAllocator mapArena;
+    auto mapAll = [&](auto build) {
+        size_t found = 0;
+        for (size_t i = 0; i < lookups.size();) {
+            auto object = lookups[i].first;
+            auto map = build(object);
+            for (; i < lookups.size() && lookups[i].first == object; ++i) {
+                found += map.count(lookups[i].second.ToStd()) != 0;
+            }
+        }
+        sink = found;
+    };
+
+    results.push_back(Measure(opts, corpus, "GetObjectAsMap",
+                              lookups.size(), 0, nop, [&] {
+                                  mapAll([&](Element *e) {
+                                      return e->GetObjectAsMap(arena);
+                                  });
+                              }));
+
+    struct FlatAdapter {
+        ObjectMap map;
+        size_t count(std::string_view key) const {
+            return map.Contains({key.data(), key.size()});
+        }
+    };
+
+    results.push_back(Measure(
+        opts, corpus, "GetObjectAsFlatMap", lookups.size(), 0,
+        [&] { mapArena.Reset(); },
+        [&] {
+            mapAll([&](Element *e) {
+                return FlatAdapter{e->GetObjectAsFlatMap(mapArena)};
+            });
+        }));
+
+    results.push_back(Measure(opts, corpus, "Iterate", nodes, 0, nop, [&] {
+        size_t count = 0;
+        for (auto root : roots) {
+            count += IterateTree(root, arena);
+        }
+        sink = count;
+    }));
+
+    // Strings are unescaped during the parse, so this measures the cached
+    // path that users hit on every read
+    results.push_back(Measure(opts, corpus, "GetString", nodes, 0, nop, [&] {
+        size_t size = 0;
+        auto get = [&](Element *elem) {
+            size += elem->GetString(arena).Size();
+        };
+        for (auto root : roots) {
+            Walk(root, get);
+        }
+        sink = size;
+    }));
+
+    results.push_back(Measure(opts, corpus, "GetNumber", nodes, 0, nop, [&] {
+        size_t count = 0;
+        auto get = [&](Element *elem) {
+            if (elem->type != Element::Type::Number) {
+                return;
+            }
+
+            int64_t i;
+            double d;
+            if (elem->GetInteger(i) || elem->GetFloatingPoint(d)) {
+                count++;
+            }
+        };
+        for (auto root : roots) {
+            Walk(root, get);
+        }
+        sink = count;
+    }));
+
+    // The serializers are measured by the text they write
+    std::ostringstream s;
+    for (auto root : roots) {
+        root->Serialize(arena, s);
+    }
+    size_t written = s.tellp();
+
+    results.push_back(Measure(
+        opts, corpus, "Serialize", nodes, written,
+        [&] {
+            s.str({});
+            s.clear();
+        },
+        [&] {
+            for (auto root : roots) {
+                root->Serialize(arena, s);
+            }
+            sink = s.tellp();
+        }));
+
+    results.push_back(Measure(
+        opts, corpus, "SerializeParallel", nodes, written,
+        [&] {
+            s.str({});
+            s.clear();
+        },
+        [&] {
+            for (auto root : roots) {
+                SerializeParallel(root, s);
+            }
+            sink = s.tellp();
+        }));
+
+    // The writes are discarded, so this measures gathering and the syscalls
+    FILE *devNull = fopen("/dev/null", "w");
+    if (devNull) {
+        results.push_back(
+            Measure(opts, corpus, "SerializeToFd", nodes, written, nop, [&] {
+                bool ok = true;
+                for (auto root : roots) {
+                    ok &= SerializeToFd(root, arena, fileno(devNull));
+                }
+                sink = ok;
+            }));
+        fclose(devNull);
+    }
+
+    // And the MessagePack ops by the packed bytes
+    std::vector<std::string> packed(roots.size());
+    size_t packedSize = 0;
+    for (size_t i = 0; i < roots.size(); ++i) {
+        roots[i]->ToMessagePack(arena, packed[i]);
+        packedSize += packed[i].size();
+    }
+
+    results.push_back(Measure(
+        opts, corpus, "ToMessagePack", nodes, packedSize,
+        [&] {
+            for (auto &p : packed) {
+                p.clear();
+            }
+        },
+        [&] {
+            bool ok = true;
+            for (size_t i = 0; i < roots.size(); ++i) {
+                ok &= roots[i]->ToMessagePack(arena, packed[i]);
+            }
+            sink = ok;
+        }));
+
+    // Read into a separate arena, so that the text trees stay valid
+    ArenaAllocator packedArena;
+    results.push_back(Measure(
+        opts, corpus, "ParseMessagePack", nodes, packedSize,
+        [&] { packedArena.Reset(); },
+        [&] {
+            bool ok = true;
+            for (auto &p : packed) {
+                auto root = packedArena.CreateElement();
+                ok &= root->ParseMessagePack({p.data(), p.size()}, packedArena);
+            }
+            sink = ok;
+        }));
+
+    std::string cbor;
+    results.push_back(Measure(
+        opts, corpus, "MessagePackToCBOR", nodes, packedSize,
+        [&] { cbor.clear(); },
+        [&] {
+            bool ok = true;
+            for (auto &p : packed) {
+                ok &= MessagePackToCBOR({p.data(), p.size()}, cbor);
+            }
+            sink = ok;
+        }));
+
+    // These work on the raw text, so they are measured per byte only
+    results.push_back(Measure(opts, corpus, "Validate", nodes, size, nop, [&] {
+        size_t valid = 0;
+        for (auto doc : corpus.docs) {
+            valid += static_cast<bool>(Validate(doc));
+        }
+        sink = valid;
+    }));
+
+    std::string scratch(corpus.body.size(), '\0');
+    results.push_back(Measure(opts, corpus, "Minify", nodes, size, nop, [&] {
+        size_t size = 0;
+        for (auto doc : corpus.docs) {
+            size += Minify(doc, scratch.data());
+        }
+        sink = size;
+    }));
+
+    return true;
+}
+
+static void ProfilePhase(Counters &counters, const Corpus &corpus,
+                         const char *phase, size_t nodes,
+                         const std::function<void()> &setup,
+                         const std::function<void()> &run,
+                         std::vector<Profile> &profiles) {
+    Profile p;
+    p.corpus = corpus.name;
+    p.phase = phase;
+    p.reps = 10;
+    p.nodes = nodes;
+    p.bytes = corpus.body.size();
+
+    for (int c = 0; c < Counters::Count; ++c) {
+        p.available[c] = counters.Available(Counters::Counter(c));
+        p.values[c] = 0;
+    }
+
+    for (size_t i = 0; i < p.reps; ++i) {
+        setup();
+
+        counters.Start();
+        run();
+        counters.Stop();
+
+        for (int c = 0; c < Counters::Count; ++c) {
+            p.values[c] += counters.Value(Counters::Counter(c));
+        }
+    }
+
+    profiles.push_back(p);
+}
+
+/**
+ * Count cycles, instructions, misses and faults for the parse, lookup and
+ * serialize phases of a corpus.
+ */
+static bool ProfileCorpus(const Corpus &corpus,
+                          std::vector<Profile> &profiles) {
+    Counters counters;
+    ArenaAllocator arena;
+    std::vector<Element *> roots;
+
+    if (!ParseAll(corpus, arena, roots)) {
+        return false;
+    }
+
+    size_t nodes = 0;
+    for (auto root : roots) {
+        nodes += CountNodes(root);
+    }
+
+    ProfilePhase(
+        counters, corpus, "parse", nodes, [&] { arena.Reset(); },
+        [&] { ParseAll(corpus, arena, roots); }, profiles);
+
+    std::string keys;
+    auto lookups = CollectLookups(roots, arena, keys);
+    ProfilePhase(
+        counters, corpus, "lookup", lookups.size(), [] {},
+        [&] { sink = FindAll(lookups, arena); }, profiles);
+
+    std::ostringstream s;
+    ProfilePhase(
+        counters, corpus, "serialize", nodes,
+        [&] {
+            s.str({});
+            s.clear();
+        },
+        [&] {
+            for (auto root : roots) {
+                root->Serialize(arena, s);
+            }
+            sink = s.tellp();
+        },
+        profiles);
+
+    return true;
+}
+
+static void WriteResults(std::ostream &s, const std::vector<Result> &results,
+                         const std::vector<Profile> &profiles) {
+    s << "{\n  \"benchmarks\": [";
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto &r = results[i];
+        s << (i ? "," : "") << "\n    {\"corpus\": \"" << r.corpus
+          << "\", \"op\": \"" << r.op << "\", \"iterations\": " << r.iterations
+          << ", \"ns_per_iter\": " << std::fixed << std::setprecision(1)
+          << r.nsPerIter << ", \"mb_per_s\": ";
+        if (r.hasBytes) {
+            s << std::setprecision(2) << r.mbPerSec;
+        } else {
+            s << "null";
+        }
+        s << ", \"ns_per_node\": " << std::setprecision(3) << r.nsPerNode
+          << "}";
+    }
+
+    s << "\n  ]";
+
+    if (!profiles.empty()) {
+        s << ",\n  \"counters\": [";
+
+        for (size_t i = 0; i < profiles.size(); ++i) {
+            auto &p = profiles[i];
+            double mb = p.bytes / (1024.0 * 1024.0);
+
+            s << (i ? "," : "") << "\n    {\"corpus\": \"" << p.corpus
+              << "\", \"phase\": \"" << p.phase << "\", \"reps\": " << p.reps;
+
+            for (int c = 0; c < Counters::Count; ++c) {
+                auto name = Counters::Name(Counters::Counter(c));
+                double perRep = double(p.values[c]) / p.reps;
+
+                s << ", \"" << name << "_per_mb\": ";
+                if (p.available[c]) {
+                    s << std::setprecision(1) << perRep / mb;
+                } else {
+                    s << "null";
+                }
+
+                s << ", \"" << name << "_per_node\": ";
+                if (p.available[c] && p.nodes) {
+                    s << std::setprecision(4) << perRep / p.nodes;
+                } else {
+                    s << "null";
+                }
+            }
+
+            s << "}";
+        }
+
+        s << "\n  ]";
+    }
+
+    s << "\n}\n";
+}
+
+/**
+ * Compare against results from an earlier run, returns false if any
+ * benchmark got slower than the threshold allows.
+ */
+static bool CompareBaseline(const Options &opts,
+                            const std::vector<Result> &results) {
+    auto body = ReadFile(opts.baseline);
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+
+    if (body.empty() || !root->ParseBody({body.data(), body.size()}, arena)) {
+        std::cerr << "Failed to read baseline " << opts.baseline << std::endl;
+        return false;
+    }
+
+    auto benchmarks = root->FindChildElement("benchmarks", arena);
+    if (!benchmarks) {
+        std::cerr << "Baseline has no benchmarks" << std::endl;
+        return false;
+    }
+
+    bool ok = true;
+
+    benchmarks->IterateArray([&](auto, Element *b) {
+        auto corpus = b->FindChildElement("corpus", arena);
+        auto op = b->FindChildElement("op", arena);
+        auto ns = b->FindChildElement("ns_per_iter", arena);
+        double before;
+
+        if (!corpus || !op || !ns || !ns->GetFloatingPoint(before)) {
+            return;
+        }
+
+        for (auto &r : results) {
+            if (corpus->GetString(arena) != r.corpus.c_str() ||
+                op->GetString(arena) != r.op.c_str()) {
+                continue;
+            }
+
+            double change = (r.nsPerIter - before) / before * 100.0;
+            bool regressed = change > opts.threshold;
+            ok = ok && !regressed;
+
+            std::cerr << std::left << std::setw(12) << r.corpus
+                      << std::setw(18) << r.op << std::right << std::fixed
+                      << std::setprecision(1) << std::showpos << std::setw(8)
+                      << change << std::noshowpos << "%"
+                      << (regressed ? "  REGRESSION" : "") << std::endl;
+        }
+    });
+
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    Options opts;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--out" && hasValue) {
+            opts.out = argv[++i];
+        } else if (arg == "--baseline" && hasValue) {
+            opts.baseline = argv[++i];
+        } else if (arg == "--threshold" && hasValue) {
+            opts.threshold = atof(argv[++i]);
+        } else if (arg == "--min-time" && hasValue) {
+            opts.minTime = atof(argv[++i]);
+        } else if (arg == "--counters") {
+            opts.counters = true;
+        } else if (arg.rfind("--", 0) != 0) {
+            opts.path = arg;
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [tests dir] [--out results.json]"
+                         " [--baseline results.json] [--threshold percent]"
+                         " [--min-time seconds] [--counters]"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Corpus> corpora = {
+        {"twitter", ReadFile(opts.path + "/tmp/twitter.json"), {}},
+        {"canada", ReadFile(opts.path + "/tmp/canada.json"), {}},
+        {"citm", ReadFile(opts.path + "/tmp/citm_catalog.json"), {}},
+        {"ndjson", ReadFile(opts.path + "/tmp/one-json-per-line.jsons"), {}},
+    };
+
+    std::vector<Result> results;
+    std::vector<Profile> profiles;
+
+    if (opts.counters) {
+        Counters probe;
+        if (!probe.Available(Counters::Cycles)) {
+            std::cerr << "Hardware counters are not available, see "
+                         "/proc/sys/kernel/perf_event_paranoid. Only page "
+                         "faults will be counted."
+                      << std::endl;
+        }
+    }
+
+    for (auto &corpus : corpora) {
+        if (corpus.body.empty()) {
+            std::cerr << "Failed to read " << corpus.name << " from "
+                      << opts.path << std::endl;
+            return 1;
+        }
+
+        auto begin = corpus.body.data();
+        auto end = begin + corpus.body.size();
+
+        if (corpus.name == "ndjson") {
+            while (begin != end) {
+                auto lineEnd = std::find(begin, end, '\n');
+                if (lineEnd != begin) {
+                    corpus.docs.emplace_back(begin, lineEnd);
+                }
+                begin = lineEnd == end ? end : lineEnd + 1;
+            }
+        } else {
+            corpus.docs.emplace_back(begin, end);
+        }
+
+        size_t first = results.size();
+        if (!BenchCorpus(opts, corpus, results)) {
+            return 1;
+        }
+
+        for (auto it = results.begin() + first; it != results.end(); ++it) {
+            std::cerr << std::left << std::setw(12) << it->corpus
+                      << std::setw(18) << it->op << std::right << std::fixed
+                      << std::setprecision(2) << std::setw(10);
+            if (it->hasBytes) {
+                std::cerr << it->mbPerSec;
+            } else {
+                std::cerr << "n/a";
+            }
+            std::cerr << " MB/s" << std::setprecision(3) << std::setw(10)
+                      << it->nsPerNode << " ns/node" << std::endl;
+        }
+
+        if (opts.counters) {
+            first = profiles.size();
+            if (!ProfileCorpus(corpus, profiles)) {
+                return 1;
+            }
+
+            for (auto it = profiles.begin() + first; it != profiles.end();
+                 ++it) {
+                std::cerr << std::left << std::setw(12) << it->corpus
+                          << std::setw(18) << it->phase << std::right;
+
+                for (int c = 0; c < Counters::Count; ++c) {
+                    std::cerr << " " << Counters::Name(Counters::Counter(c))
+                              << "/node=";
+                    if (it->available[c]) {
+                        std::cerr << std::setprecision(3)
+                                  << double(it->values[c]) / it->reps /
+                                         it->nodes;
+                    } else {
+                        std::cerr << "n/a";
+                    }
+                }
+
+                std::cerr << std::endl;
+            }
+        }
+    }
+
+    if (opts.out.empty()) {
+        WriteResults(std::cout, results, profiles);
+    } else {
+        std::ofstream s(opts.out);
+        WriteResults(s, results, profiles);
+    }
+
+    if (!opts.baseline.empty() && !CompareBaseline(opts, results)) {
+        return 2;
+    }
+
+    return 0;
+}
@@ -1,18 +1,27 @@
 #pragma once
 #include "fast_float/fast_float.h"
+#include "stupid-json/trace.hpp"
 
 #include <algorithm>
 #include <cassert>
 #include <charconv>
+#include <cmath>
 #include <cstring>
+#include <limits>
 #include <ostream>
+#include <string>
 #include <string_view>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
 namespace StupidJSON {
 
 class ArenaAllocator;
+class Projection;
+class Shape;
+class ObjectMap;
+template <typename T> class ArenaSpan;
 
 struct StringView {
     const char *begin;
@@ -63,6 +72,53 @@ struct StringView {
     }
 };
 
+/**
+ * Unescape a raw JSON string. If the string is already clean, the result
+ * points to the source, otherwise the unescaped string is put in the arena.
+ */
+bool UnescapeString(StringView raw, StringView &clean, ArenaAllocator &arena);
+
+/**
+ * Compare a raw JSON key to an unescaped name. The key is only unescaped into
+ * the arena if it contains escapes.
+ */
+bool KeyEquals(StringView raw, StringView name, ArenaAllocator &arena);
+
+/**
+ * Format a number as JSON, using the shortest form that round trips for
+ * floating point. Returns nullptr if the number is not finite or doesn't fit.
+ */
+template <typename T> char *FormatNumber(T val, char *first, char *last) {
+    static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>,
+                  "Only numbers can be formatted");
+
+    if constexpr (std::is_floating_point_v<T>) {
+        if (!std::isfinite(val)) {
+            return nullptr;
+        }
+    }
+
+    auto res = std::to_chars(first, last, val);
+    return res.ec == std::errc() ? res.ptr : nullptr;
+}
+
+/**
+ * Optional settings for Element::ParseBody
+ */
+struct ParseOptions {
+    // Only parse the members on these paths, the projection must outlive the
+    // call to ParseBody
+    const Projection *projection = nullptr;
+
+    // Decode the numbers in arrays while parsing, so that reading them later
+    // doesn't have to parse the text again
+    bool decodeNumbers = false;
+
+    // Check keys against the ones learned from earlier objects and learn
+    // from this one, for streams of records that share a schema
+    Shape *shape = nullptr;
+};
+
 struct Element {
     enum class Type {
         Error = 0,
@@ -76,8 +132,14 @@ struct Element {
         False,
     };
 
+    enum class Decoded : uint32_t {
+        None = 0,
+        Integer,
+        FloatingPoint,
+    };
+
     Type type;
-    StringView ref;
+    StringView ref; // Source text, containers include their brackets
     Element *next;
     Element *firstChild;
     union {
@@ -87,15 +149,68 @@ struct Element {
         };
         StringView
             cleanRef; // Only used for String or Key to contain escaped version
+        struct {
+            union {
+                int64_t intValue;
+                double floatValue;
+            };
+            Decoded decoded; // Only used for Number, when the text is decoded
+        };
     };
 
     bool ParseBody(StringView body, ArenaAllocator &arena,
                    const char **term = nullptr);
+    bool ParseBody(StringView body, ArenaAllocator &arena,
+                   const ParseOptions &options, const char **term = nullptr);
 
     bool Serialize(ArenaAllocator &arena, std::ostream &s, int level = 0);
 
+    /**
+     * Append this element to out as MessagePack or CBOR, with the exact
+     * length in the header of every container. Numbers are decoded in place,
+     * so writing the tree again doesn't parse their text again.
+     */
+    bool ToMessagePack(ArenaAllocator &arena, std::string &out);
+    bool ToCBOR(ArenaAllocator &arena, std::string &out);
+
+    /**
+     * Build the tree from a MessagePack or CBOR value. Like with ParseBody,
+     * strings point into body, so it has to outlive the tree. Values that
+     * JSON has no equivalent for, such as binary data, fail.
+     */
+    bool ParseMessagePack(StringView body, ArenaAllocator &arena,
+                          const char **term = nullptr);
+    bool ParseCBOR(StringView body, ArenaAllocator &arena,
+                   const char **term = nullptr);
+
     StringView GetString(ArenaAllocator &arena);
     StringView GetEscapedString(ArenaAllocator &arena);
+
+    /**
+     * Finish all the work that reads otherwise do lazily: unescape and escape
+     * every string below this element and decode every number. Afterwards
+     * the const methods that take no arena can be used, and since reading
+     * through them writes nothing, from any number of threads at once.
+     *
+     * The tree must not be modified while it is being read that way.
+     */
+    bool Freeze(ArenaAllocator &arena);
+
+    /**
+     * Only valid on frozen elements
+     */
+    inline StringView GetString() const {
+        assert((type != Type::String && type != Type::Key) ||
+               cleanRef.begin != nullptr);
+        return type == Type::String || type == Type::Key ? cleanRef
+                                                         : StringView();
+    }
+    inline StringView GetEscapedString() const {
+        assert((type != Type::String && type != Type::Key) ||
+               ref.begin != nullptr);
+        return type == Type::String || type == Type::Key ? ref
+                                                         : StringView();
+    }
     void SetString(StringView str);
     void Setkey(StringView key);
 
@@ -105,17 +220,66 @@ struct Element {
     bool ObjectAssign(StringView key, Element *value, ArenaAllocator &arena);
     bool ValuePush(Element *key);
 
+    /**
+     * Apply an RFC 7396 merge patch in place. Existing nodes are reused where
+     * possible, members patched with null are removed, and new values are
+     * copied into the arena so that the patch can be released afterwards.
+     */
+    bool ApplyMergePatch(const Element *patch, ArenaAllocator &arena);
+
+    /**
+     * Deep copy this element and everything below it into another arena,
+     * including its strings, so that the copy is independent of both the
+     * source buffer and the source arena.
+     */
+    Element *CloneInto(ArenaAllocator &dst) const;
+
+    /**
+     * Like CloneInto, but the copy of this element is written over target,
+     * which keeps its place among its siblings. Target is left as it is if
+     * the arena runs out of memory.
+     */
+    bool CloneOver(Element *target, ArenaAllocator &dst) const;
+
     void EscapeStr(ArenaAllocator &arena);
     bool UnescapeStr(ArenaAllocator &arena);
 
-    template <typename T> bool GetInteger(T &val);
-    template <typename T> bool GetFloatingPoint(T &val);
+    template <typename T> bool GetInteger(T &val) const;
+    template <typename T> bool GetFloatingPoint(T &val) const;
     template <typename T> bool SetNumber(T val, ArenaAllocator &arena);
 
+    /**
+     * Decode the text of a number once, so that GetInteger and
+     * GetFloatingPoint can return it without parsing it again
+     */
+    bool DecodeNumber();
+
+    /**
+     * Read an array of numbers into out, which has room for n values. Fails
+     * if the array is longer than n or contains anything but numbers that fit
+     * in T.
+     */
+    template <typename T> bool GetNumberArray(T *out, size_t n) const;
+
+    /**
+     * Read an array of arrays that each contain arity numbers, such as a list
+     * of coordinates, into out. Tuple i starts at out[i * stride], and out has
+     * room for n tuples.
+     */
+    template <typename T>
+    bool GetNumberTuples(T *out, size_t arity, size_t stride, size_t n) const;
+
     Element *GetArrayIndex(uint32_t index);
     Element *FindKey(StringView name, ArenaAllocator &arena);
     Element *FindChildElement(StringView name, ArenaAllocator &arena);
 
+    /**
+     * Lookups on frozen elements, without an arena
+     */
+    const Element *GetArrayIndex(uint32_t index) const;
+    const Element *FindKey(StringView name) const;
+    const Element *FindChildElement(StringView name) const;
+
     template <typename L> bool IterateArray(L l) {
         if (type != Type::Array) {
             return false;
@@ -130,6 +294,20 @@ struct Element {
         return true;
     }
 
+    template <typename L> bool IterateArray(L l) const {
+        if (type != Type::Array) {
+            return false;
+        }
+
+        size_t index = 0;
+
+        for (const Element *it = firstChild; it != nullptr; it = it->next) {
+            l(index++, it);
+        }
+
+        return true;
+    }
+
     template <typename L> bool IterateObject(ArenaAllocator &arena, L l) {
         if (type != Type::Object) {
             return false;
@@ -143,6 +321,22 @@ struct Element {
         return true;
     }
 
+    /**
+     * Only valid on frozen elements
+     */
+    template <typename L> bool IterateObject(L l) const {
+        if (type != Type::Object) {
+            return false;
+        }
+
+        for (const Element *it = firstChild; it != nullptr; it = it->next) {
+            assert(it->type == Type::Key);
+            l(it->GetString(), static_cast<const Element *>(it->firstChild));
+        }
+
+        return true;
+    }
+
     inline std::vector<Element *> GetChildrenAsVector() {
         std::vector<Element *> arr;
 
@@ -167,6 +361,14 @@ struct Element {
 
         return map;
     }
+
+    /**
+     * Like GetChildrenAsVector and GetObjectAsMap, but the containers are
+     * allocated from the arena and live as long as it. Include
+     * stupid-json/containers.hpp to use these.
+     */
+    ArenaSpan<Element *> GetChildrenAsSpan(ArenaAllocator &arena);
+    ObjectMap GetObjectAsFlatMap(ArenaAllocator &arena);
 };
 
 class ArenaAllocator {
@@ -224,8 +426,39 @@ class ArenaAllocator {
         return &el;
     }
 
+    /**
+     * Add count consecutive elements and return a pointer to the first one
+     */
+    Element *CreateElements(size_t count);
+
     char *AllocateString(size_t size);
-    void ReturnUnused(size_t size);
+
+    /**
+     * Give back the last size bytes of the string allocation that ends at
+     * end. Nothing is returned unless it is the latest allocation of its
+     * block.
+     */
+    void ReturnUnused(const char *end, size_t size);
+
+    /**
+     * Allocate uninitialized memory from the string blocks, aligned to align
+     * which has to be a power of two. Returns nullptr if out of memory.
+     */
+    void *Allocate(size_t size, size_t align);
+
+    /**
+     * Room for count objects of type T. Nothing is constructed or ever
+     * destroyed, so T has to be trivial.
+     */
+    template <typename T> inline T *AllocateArray(size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>);
+        return static_cast<T *>(Allocate(count * sizeof(T), alignof(T)));
+    }
+
+    /**
+     * Bytes held in blocks by the allocator, used or not
+     */
+    size_t Footprint() const;
 
     /**
      * Push a string to a stable position in the arena and return a
@@ -341,33 +574,110 @@ inline bool Element::ValuePush(Element *value) {
     return true;
 }
 
-template <typename T> bool Element::GetInteger(T &val) {
+template <typename T> bool Element::GetInteger(T &val) const {
     if (type != Type::Number)
         return false;
+
+    if (decoded == Decoded::Integer) {
+        if constexpr (std::is_signed_v<T>) {
+            if (intValue < std::numeric_limits<T>::min() ||
+                intValue > std::numeric_limits<T>::max()) {
+                return false;
+            }
+        } else {
+            if (intValue < 0 ||
+                static_cast<uint64_t>(intValue) >
+                    std::numeric_limits<T>::max()) {
+                return false;
+            }
+        }
+
+        val = static_cast<T>(intValue);
+        return true;
+    }
+
+    // A fraction or an exponent stops the parse early, and makes it no
+    // integer
     auto res = std::from_chars(ref.begin, ref.end, val);
 
-    return res.ec == std::errc();
+    return res.ec == std::errc() && res.ptr == ref.end;
 }
 
-template <typename T> bool Element::GetFloatingPoint(T &val) {
+template <typename T> bool Element::GetFloatingPoint(T &val) const {
     if (type != Type::Number)
         return false;
+
+    // Rounding a decoded double to a float could differ from parsing the text
+    // as a float, so only doubles use the decoded value
+    if (decoded == Decoded::Integer) {
+        val = static_cast<T>(intValue);
+        return true;
+    }
+
+    if constexpr (std::is_same_v<T, double>) {
+        if (decoded == Decoded::FloatingPoint) {
+            val = floatValue;
+            return true;
+        }
+    }
+
     auto res = fast_float::from_chars(ref.begin, ref.end, val);
 
     return res.ec == std::errc();
 }
 
+template <typename T> bool Element::GetNumberArray(T *out, size_t n) const {
+    if (type != Type::Array || childCount > n) {
+        return false;
+    }
+
+    for (auto it = firstChild; it != nullptr; it = it->next) {
+        bool ok;
+        if constexpr (std::is_integral_v<T>) {
+            ok = it->GetInteger(*out++);
+        } else {
+            ok = it->GetFloatingPoint(*out++);
+        }
+
+        if (!ok) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template <typename T>
+bool Element::GetNumberTuples(T *out, size_t arity, size_t stride,
+                              size_t n) const {
+    if (type != Type::Array || childCount > n || stride < arity) {
+        return false;
+    }
+
+    for (auto it = firstChild; it != nullptr; it = it->next) {
+        if (it->type != Type::Array || it->childCount != arity ||
+            !it->GetNumberArray(out, arity)) {
+            return false;
+        }
+
+        out += stride;
+    }
+
+    return true;
+}
+
 template <typename T> bool Element::SetNumber(T val, ArenaAllocator &arena) {
-    if (!std::isfinite(val)) {
+    char buf[64];
+    char *numEnd = FormatNumber(val, buf, buf + sizeof(buf));
+    if (!numEnd) {
         type = Type::Error;
         ref = "Failed to set number";
         return false;
     }
 
-    // Temporary hack while I can't be bothered
-    auto buf = std::to_string(val);
     type = Type::Number;
-    ref = arena.PushString({buf.data(), buf.size()});
+    ref = arena.PushString({buf, numEnd});
+    decoded = Decoded::None;
 
     return true;
 }
@@ -392,6 +702,8 @@ inline Element *Element::FindKey(StringView name, ArenaAllocator &arena) {
         return nullptr;
     }
 
+    STUPID_JSON_TRACE_HOOK(FindKey, this, name.begin, name.end);
+
     auto it = firstChild;
 
     while (it) {
@@ -416,6 +728,47 @@ inline Element *Element::FindChildElement(StringView name,
     return nullptr;
 }
 
+inline const Element *Element::GetArrayIndex(uint32_t index) const {
+    if (type != Type::Array || childCount <= index) {
+        return nullptr;
+    }
+
+    uint32_t i = 0;
+    for (const Element *it = firstChild; it != nullptr; it = it->next) {
+        if (i++ == index) {
+            return it;
+        }
+    }
+
+    return nullptr;
+}
+
+inline const Element *Element::FindKey(StringView name) const {
+    if (type != Type::Object) {
+        return nullptr;
+    }
+
+    STUPID_JSON_TRACE_HOOK(FindKey, this, name.begin, name.end);
+
+    for (const Element *it = firstChild; it != nullptr; it = it->next) {
+        assert(it->type == Type::Key);
+
+        if (it->GetString() == name) {
+            return it;
+        }
+    }
+
+    return nullptr;
+}
+
+inline const Element *Element::FindChildElement(StringView name) const {
+    const Element *key = FindKey(name);
+    if (key)
+        return key->firstChild;
+
+    return nullptr;
+}
+
 inline bool Element::ObjectAssign(StringView key, Element *value,
                                   ArenaAllocator &arena) {
     if (value->type == Type::Key || value->type == Type::Error)
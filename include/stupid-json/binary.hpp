@@ -0,0 +1,26 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+
+#include <string>
+
+namespace StupidJSON {
+
+/**
+ * Containers nested deeper than this fail to read, so that malicious input
+ * can't run the reader out of stack
+ */
+static const size_t binaryMaxDepth = 1024;
+
+/**
+ * Convert a MessagePack value to CBOR or back, item by item and without
+ * building a tree. The input is held to the JSON data model, so the result
+ * is the same as reading it into an Element and writing that, and input the
+ * readers reject fails here too. On failure out holds a partial result.
+ *
+ * CBOR containers of indefinite length are counted before they are written,
+ * since MessagePack needs the length up front.
+ */
+bool MessagePackToCBOR(StringView body, std::string &out);
+bool CBORToMessagePack(StringView body, std::string &out);
+
+} // namespace StupidJSON
@@ -0,0 +1,307 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+#include "stupid-json/tokenizer.hpp"
+
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace StupidJSON {
+
+/**
+ * Binds a JSON key to a member of a struct.
+ */
+template <typename T, typename M> struct Field {
+    std::string_view name;
+    M T::*member;
+};
+
+template <typename T, typename M>
+constexpr Field<T, M> BindField(std::string_view name, M T::*member) {
+    return {name, member};
+}
+
+/**
+ * Specialize with a constexpr tuple of fields named "fields" to make a struct
+ * parsable with Parse, or use the STUPID_JSON_BIND macro:
+ *
+ *   STUPID_JSON_BIND(Point, STUPID_JSON_FIELD(Point, x),
+ *                    STUPID_JSON_FIELD(Point, y))
+ */
+template <typename T> struct Binding;
+
+#define STUPID_JSON_FIELD(Type, member)                                        \
+    StupidJSON::BindField(#member, &Type::member)
+
+#define STUPID_JSON_BIND(Type, ...)                                            \
+    template <> struct StupidJSON::Binding<Type> {                             \
+        static constexpr auto fields = std::make_tuple(__VA_ARGS__);           \
+    };
+
+namespace Bind {
+
+template <typename T, typename = void> struct IsBound : std::false_type {};
+template <typename T>
+struct IsBound<T, std::void_t<decltype(Binding<T>::fields)>> : std::true_type {
+};
+
+template <typename T> struct IsVector : std::false_type {};
+template <typename T, typename A>
+struct IsVector<std::vector<T, A>> : std::true_type {};
+
+template <typename T>
+const char *ReadValue(const char *begin, const char *end, T &out,
+                      ArenaAllocator &arena);
+
+inline const char *ReadString(const char *begin, const char *end,
+                              StringView &out, ArenaAllocator &arena) {
+    if (begin == end || *begin != '\"') {
+        return nullptr;
+    }
+
+    auto strEnd = Tokenizer::SkipString(begin + 1, end);
+    if (strEnd == end) {
+        return nullptr;
+    }
+
+    if (!UnescapeString({begin + 1, strEnd}, out, arena)) {
+        return nullptr;
+    }
+
+    return strEnd + 1;
+}
+
+inline const char *ReadToken(const char *begin, const char *end,
+                             StringView token) {
+    if (static_cast<size_t>(end - begin) < token.Size() ||
+        memcmp(begin, token.begin, token.Size()) != 0) {
+        return nullptr;
+    }
+
+    return begin + token.Size();
+}
+
+template <typename T, size_t... I>
+const char *ReadMember(StringView key, const char *begin, const char *end,
+                       T &out, ArenaAllocator &arena,
+                       std::index_sequence<I...>) {
+    const char *res = nullptr;
+    bool matched = false;
+
+    // Unrolled at compile time into one length check and compare per field
+    (void)((key.ToStd() == std::get<I>(Binding<T>::fields).name &&
+            (matched = true,
+             res = ReadValue(begin, end,
+                             out.*(std::get<I>(Binding<T>::fields).member),
+                             arena),
+             true)) ||
+           ...);
+
+    if (!matched) {
+        return Tokenizer::SkipValue(begin, end);
+    }
+
+    return res;
+}
+
+template <typename T>
+const char *ReadObject(const char *begin, const char *end, T &out,
+                       ArenaAllocator &arena) {
+    using namespace Tokenizer;
+    constexpr auto fieldCount =
+        std::tuple_size_v<std::decay_t<decltype(Binding<T>::fields)>>;
+
+    if (begin == end || *begin != '{') {
+        return nullptr;
+    }
+
+    begin = FwdSpaces(begin + 1, end);
+    if (begin != end && *begin == '}') {
+        return begin + 1;
+    }
+
+    while (begin != end) {
+        if (*begin != '\"') {
+            return nullptr;
+        }
+
+        auto keyEnd = SkipString(begin + 1, end);
+        if (keyEnd == end) {
+            return nullptr;
+        }
+
+        StringView key(begin + 1, keyEnd);
+        if (FindChar(key.begin, key.end, '\\') != key.end &&
+            !UnescapeString({begin + 1, keyEnd}, key, arena)) {
+            return nullptr;
+        }
+
+        begin = FwdSpaces(keyEnd + 1, end);
+        if (begin == end || *begin != ':') {
+            return nullptr;
+        }
+
+        begin = FwdSpaces(begin + 1, end);
+        begin = ReadMember(key, begin, end, out, arena,
+                           std::make_index_sequence<fieldCount>());
+        if (!begin) {
+            return nullptr;
+        }
+
+        begin = FwdSpaces(begin, end);
+        if (begin == end) {
+            return nullptr;
+        }
+
+        if (*begin == '}') {
+            return begin + 1;
+        }
+
+        if (*begin != ',') {
+            return nullptr;
+        }
+
+        begin = FwdSpaces(begin + 1, end);
+    }
+
+    return nullptr;
+}
+
+template <typename T>
+const char *ReadArray(const char *begin, const char *end, T &out,
+                      ArenaAllocator &arena) {
+    using namespace Tokenizer;
+
+    if (begin == end || *begin != '[') {
+        return nullptr;
+    }
+
+    out.clear();
+
+    begin = FwdSpaces(begin + 1, end);
+    if (begin != end && *begin == ']') {
+        return begin + 1;
+    }
+
+    while (begin != end) {
+        begin = ReadValue(begin, end, out.emplace_back(), arena);
+        if (!begin) {
+            return nullptr;
+        }
+
+        begin = FwdSpaces(begin, end);
+        if (begin == end) {
+            return nullptr;
+        }
+
+        if (*begin == ']') {
+            return begin + 1;
+        }
+
+        if (*begin != ',') {
+            return nullptr;
+        }
+
+        begin = FwdSpaces(begin + 1, end);
+    }
+
+    return nullptr;
+}
+
+template <typename T>
+const char *ReadValue(const char *begin, const char *end, T &out,
+                      ArenaAllocator &arena) {
+    if (begin == end) {
+        return nullptr;
+    }
+
+    // A null leaves the target untouched, whatever its type
+    if (*begin == 'n') {
+        return ReadToken(begin, end, "null");
+    }
+
+    // Targets are only written once the whole value was read
+    if constexpr (std::is_same_v<T, bool>) {
+        bool value = *begin == 't';
+        auto next = ReadToken(begin, end, value ? "true" : "false");
+        if (next) {
+            out = value;
+        }
+        return next;
+    } else if constexpr (std::is_integral_v<T>) {
+        // The grammar is checked first, from_chars alone takes forms like 01
+        auto numEnd = Tokenizer::ScanNumber(begin, end);
+        if (!numEnd) {
+            return nullptr;
+        }
+
+        T value;
+        auto res = std::from_chars(begin, numEnd, value);
+        if (res.ec != std::errc() || res.ptr != numEnd) {
+            return nullptr;
+        }
+
+        out = value;
+        return numEnd;
+    } else if constexpr (std::is_floating_point_v<T>) {
+        auto numEnd = Tokenizer::ScanNumber(begin, end);
+        if (!numEnd) {
+            return nullptr;
+        }
+
+        T value;
+        auto res = fast_float::from_chars(begin, numEnd, value);
+        if (res.ec != std::errc() || res.ptr != numEnd) {
+            return nullptr;
+        }
+
+        out = value;
+        return numEnd;
+    } else if constexpr (std::is_same_v<T, StringView>) {
+        return ReadString(begin, end, out, arena);
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        StringView str;
+        begin = ReadString(begin, end, str, arena);
+        if (begin) {
+            out.assign(str.begin, str.Size());
+        }
+        return begin;
+    } else if constexpr (IsVector<T>::value) {
+        return ReadArray(begin, end, out, arena);
+    } else if constexpr (IsBound<T>::value) {
+        return ReadObject(begin, end, out, arena);
+    } else {
+        static_assert(IsBound<T>::value, "Type can not be bound to JSON");
+        return nullptr;
+    }
+}
+
+} // namespace Bind
+
+/**
+ * Parse a document straight into a bound struct without building Elements.
+ * Unknown keys are skipped without being parsed, and keys missing from the
+ * document leave their members untouched. StringView members point into the
+ * body, or into the arena if the string had to be unescaped.
+ */
+template <typename T>
+bool Parse(StringView body, T &out, ArenaAllocator &arena,
+           const char **term = nullptr) {
+    auto begin = Tokenizer::FwdSpaces(body.begin, body.end);
+    auto end = Bind::ReadValue(begin, body.end, out, arena);
+
+    if (!end) {
+        return false;
+    }
+
+    if (term) {
+        *term = end;
+    }
+
+    return true;
+}
+
+} // namespace StupidJSON
@@ -0,0 +1,73 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace StupidJSON {
+
+/**
+ * Keeps parsed documents keyed by a hash of their text, so that parsing a
+ * body that was seen before returns the tree parsed the first time.
+ *
+ * Every cached document owns a copy of its text and an arena, and the least
+ * recently used documents are dropped once their combined size goes over the
+ * byte budget. Returned roots keep their document alive, so they stay valid
+ * after eviction. They are frozen, so they can be read through the const
+ * Element methods from any thread, but must not be modified.
+ *
+ * The cache can be used from several threads. Parsing happens outside of the
+ * lock, so two threads missing on the same body both parse it.
+ */
+class ParseCache {
+    struct Entry {
+        uint64_t hash;
+        StringView body; // Copy of the text, in the arena
+        ArenaAllocator arena;
+        Element *root;
+        size_t bytes;
+    };
+
+    using EntryList = std::list<std::shared_ptr<Entry>>;
+
+    mutable std::mutex mutex;
+    EntryList entries; // Most recently used first
+    std::unordered_multimap<uint64_t, EntryList::iterator> index;
+    size_t budget;
+    size_t bytes = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+
+    std::shared_ptr<Entry> Find(uint64_t hash, StringView body);
+    void Insert(std::shared_ptr<Entry> entry);
+    void Evict();
+
+  public:
+    explicit ParseCache(size_t budget);
+
+    /**
+     * Returns the tree for body, which is only parsed if no byte identical
+     * body is cached. If parsing or freezing fails, the returned root is the
+     * error element and nothing is cached.
+     */
+    std::shared_ptr<const Element> Parse(StringView body);
+
+    /**
+     * Drop every cached document. Roots that were returned stay valid.
+     */
+    void Clear();
+
+    /**
+     * Change the byte budget, evicting documents if needed
+     */
+    void SetBudget(size_t size);
+
+    size_t Count() const;
+    size_t Bytes() const;
+    size_t Hits() const;
+    size_t Misses() const;
+};
+
+} // namespace StupidJSON
@@ -0,0 +1,85 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+
+namespace StupidJSON {
+
+/**
+ * A view of count objects in an arena. It doesn't own anything, so it is
+ * cheap to copy and stays valid until the arena is reset.
+ */
+template <typename T> class ArenaSpan {
+    T *items = nullptr;
+    size_t count = 0;
+
+  public:
+    ArenaSpan() = default;
+    inline ArenaSpan(T *items, size_t count) : items(items), count(count) {}
+
+    inline T *begin() const { return items; }
+    inline T *end() const { return items + count; }
+    inline T &operator[](size_t index) const { return items[index]; }
+
+    inline T *Data() const { return items; }
+    inline size_t Size() const { return count; }
+    inline bool Empty() const { return count == 0; }
+};
+
+/**
+ * Members of an object by unescaped key, in an open addressing table
+ * allocated from the arena. Keys are the ones unescaped during parsing, so
+ * building the map copies no strings.
+ *
+ * The map is a snapshot, members added to the object afterwards are not in
+ * it. Like GetObjectAsMap, the last member wins when a key is repeated.
+ */
+class ObjectMap {
+    struct Slot {
+        StringView key;
+        Element *value; // nullptr for empty slots
+        uint32_t hash;
+    };
+
+    Slot *slots = nullptr;
+    size_t mask = 0;
+    size_t count = 0;
+
+    friend struct Element;
+
+  public:
+    Element *Find(StringView key) const;
+
+    inline bool Contains(StringView key) const { return Find(key); }
+    inline size_t Size() const { return count; }
+    inline bool Empty() const { return count == 0; }
+
+    /**
+     * Call l(key, value) for every member, in no particular order
+     */
+    template <typename L> void ForEach(L l) const {
+        for (size_t i = 0; slots && i <= mask; ++i) {
+            if (slots[i].value) {
+                l(slots[i].key, slots[i].value);
+            }
+        }
+    }
+};
+
+inline ArenaSpan<Element *> Element::GetChildrenAsSpan(ArenaAllocator &arena) {
+    if (type != Type::Array || childCount == 0) {
+        return {};
+    }
+
+    auto items = arena.AllocateArray<Element *>(childCount);
+    if (!items) {
+        return {};
+    }
+
+    size_t n = 0;
+    for (auto it = firstChild; it != nullptr && n < childCount; it = it->next) {
+        items[n++] = it;
+    }
+
+    return {items, n};
+}
+
+} // namespace StupidJSON
@@ -0,0 +1,35 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+#include "stupid-json/mmap.hpp"
+
+namespace StupidJSON {
+
+/**
+ * Owns a memory mapped source file and the tree parsed from it. Elements
+ * reference the mapping directly, so they are only valid for as long as the
+ * document is alive and has not been reopened.
+ */
+class Document {
+    MappedFile file;
+    Element *root = nullptr;
+
+  public:
+    Document() = default;
+    Document(const Document &) = delete;
+    Document(Document &&) noexcept = default;
+
+    /**
+     * Map a file and parse it in place, without copying it. Nodes and
+     * unescaped strings go into the arena as usual. The parser never reads
+     * past the end of the mapping, so no padding is needed.
+     *
+     * On failure the root is an error element, unless it couldn't be
+     * allocated.
+     */
+    bool ParseFile(const char *path, ArenaAllocator &arena);
+
+    inline Element *Root() const { return root; }
+    inline StringView Source() const { return file.View(); }
+};
+
+} // namespace StupidJSON
@@ -0,0 +1,468 @@
+#pragma once
+#include "stupid-json/flat.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace StupidJSON {
+
+/**
+ * A document parsed at compile time, in the node table layout of snapshots.
+ * Declared with STUPID_JSON_EMBED, it is a constant in read-only data, so
+ * reading it costs no parsing and no allocation at startup. Root returns a
+ * FlatElement to read it with.
+ */
+template <size_t NodeCount, size_t CharCount> struct EmbeddedDocument {
+    FlatNode nodes[NodeCount];
+    char strings[CharCount + 1]; // Never empty, and always terminated
+
+    inline FlatElement Root() const { return {nodes, strings, 0}; }
+};
+
+/**
+ * Not constexpr on purpose: reaching it while parsing a literal at compile
+ * time stops the compile, and the message is in the error output
+ */
+inline void EmbeddedSyntaxError(const char *) {}
+
+struct EmbeddedSize {
+    size_t nodes;
+    size_t chars;
+};
+
+/**
+ * Parses JSON in constant expressions. Without output it only counts the
+ * nodes and string bytes needed, so that the table can be sized before it is
+ * filled by a second run over the same text.
+ */
+class EmbeddedParser {
+    const char *text;
+    size_t size;
+    size_t pos = 0;
+
+    FlatNode *nodes;
+    char *strings;
+    uint32_t nodeCount = 0;
+    uint32_t charCount = 0;
+
+    // Every caller has a message, the check only keeps this a valid
+    // constexpr function
+    constexpr bool Fail(const char *message) {
+        if (message) {
+            EmbeddedSyntaxError(message);
+        }
+        return false;
+    }
+
+    constexpr bool AtEnd() const { return pos == size; }
+    constexpr char Peek() const { return pos < size ? text[pos] : '\0'; }
+
+    constexpr void SkipSpaces() {
+        while (pos < size && (text[pos] == ' ' || text[pos] == '\t' ||
+                              text[pos] == '\n' || text[pos] == '\r')) {
+            pos++;
+        }
+    }
+
+    constexpr uint32_t Reserve(uint32_t count) {
+        uint32_t first = nodeCount;
+        nodeCount += count;
+        return first;
+    }
+
+    constexpr void Set(uint32_t index, Element::Type type, uint32_t firstChild,
+                       uint32_t childCount, uint32_t strOffset,
+                       uint32_t strSize) {
+        if (nodes) {
+            nodes[index] = {static_cast<uint32_t>(type), firstChild,
+                            childCount, strOffset, strSize};
+        }
+    }
+
+    constexpr void Put(char c) {
+        if (strings) {
+            strings[charCount] = c;
+        }
+        charCount++;
+    }
+
+    // The items of the container that starts at pos, found by counting the
+    // commas at its own level. Mistakes are left for the parse to find.
+    constexpr uint32_t CountItems() const {
+        uint32_t commas = 0;
+        int depth = 0;
+        bool empty = true;
+
+        for (size_t i = pos + 1; i < size; ++i) {
+            char c = text[i];
+
+            if (c == '\"') {
+                for (i++; i < size && text[i] != '\"'; ++i) {
+                    i += text[i] == '\\';
+                }
+            } else if (c == '{' || c == '[') {
+                depth++;
+            } else if (c == '}' || c == ']') {
+                if (depth-- == 0) {
+                    break;
+                }
+            } else if (c == ',' && depth == 0) {
+                commas++;
+            }
+
+            if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+                empty = false;
+            }
+        }
+
+        return empty ? 0 : commas + 1;
+    }
+
+    constexpr static int HexValue(char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+
+    // Four hex digits after a \u at pos
+    constexpr int ReadUnicode() {
+        if (size - pos < 6 || text[pos] != '\\' || text[pos + 1] != 'u') {
+            return -1;
+        }
+
+        int u = 0;
+        for (size_t i = pos + 2; i < pos + 6; ++i) {
+            int val = HexValue(text[i]);
+            if (val == -1) {
+                return -1;
+            }
+            u = (u << 4) | val;
+        }
+
+        pos += 6;
+        return u;
+    }
+
+    // Same as UnescapeString, a high surrogate has to be followed by a low one
+    constexpr bool Unicode() {
+        int lit = ReadUnicode();
+        if (lit == -1) {
+            return Fail("Invalid \\u escape in string");
+        }
+
+        uint32_t u = static_cast<uint32_t>(lit);
+        if (0xD800 <= lit && lit <= 0xDBFF) {
+            lit = ReadUnicode();
+            if (lit < 0xDC00 || lit > 0xDFFF) {
+                return Fail("High surrogate without a low surrogate");
+            }
+
+            u = 0x10000 + ((u & 0x03FF) << 10) + (lit & 0x03FF);
+        }
+
+        if (u <= 0x7f) {
+            Put(static_cast<char>(u));
+        } else if (u <= 0x7ff) {
+            Put(static_cast<char>(0xc0 | (u >> 6)));
+            Put(static_cast<char>(0x80 | (u & 0x3f)));
+        } else if (u <= 0xffff) {
+            Put(static_cast<char>(0xe0 | (u >> 12)));
+            Put(static_cast<char>(0x80 | ((u >> 6) & 0x3f)));
+            Put(static_cast<char>(0x80 | (u & 0x3f)));
+        } else {
+            Put(static_cast<char>(0xf0 | (u >> 18)));
+            Put(static_cast<char>(0x80 | ((u >> 12) & 0x3f)));
+            Put(static_cast<char>(0x80 | ((u >> 6) & 0x3f)));
+            Put(static_cast<char>(0x80 | (u & 0x3f)));
+        }
+
+        return true;
+    }
+
+    // Unescaped into the string pool, pos is at the opening quote
+    constexpr bool String(uint32_t index, Element::Type type) {
+        uint32_t offset = charCount;
+        pos++;
+
+        while (true) {
+            if (AtEnd()) {
+                return Fail("String not terminated");
+            }
+
+            char c = text[pos];
+            if (c == '\"') {
+                pos++;
+                break;
+            }
+
+            if (static_cast<unsigned char>(c) < 0x20) {
+                return Fail("Control char in string");
+            }
+
+            if (c != '\\') {
+                Put(c);
+                pos++;
+                continue;
+            }
+
+            if (size - pos < 2) {
+                return Fail("String not terminated");
+            }
+
+            switch (text[pos + 1]) {
+            case '\"':
+            case '\\':
+            case '/':
+                Put(text[pos + 1]);
+                break;
+            case 'b':
+                Put('\b');
+                break;
+            case 'f':
+                Put('\f');
+                break;
+            case 'n':
+                Put('\n');
+                break;
+            case 'r':
+                Put('\r');
+                break;
+            case 't':
+                Put('\t');
+                break;
+            case 'u':
+                if (!Unicode()) {
+                    return false;
+                }
+                continue;
+            default:
+                return Fail("Invalid escape in string");
+            }
+
+            pos += 2;
+        }
+
+        Set(index, type, 0, 0, offset, charCount - offset);
+        return true;
+    }
+
+    constexpr bool Digits() {
+        if (Peek() < '0' || Peek() > '9') {
+            return false;
+        }
+
+        while (Peek() >= '0' && Peek() <= '9') {
+            pos++;
+        }
+        return true;
+    }
+
+    // The text is kept as it is, in the grammar ParseBody accepts
+    constexpr bool Number(uint32_t index) {
+        size_t begin = pos;
+
+        if (Peek() == '-') {
+            pos++;
+        }
+
+        if (Peek() == '0') {
+            pos++;
+        } else if (!Digits()) {
+            return Fail("Malformed number");
+        }
+
+        if (Peek() == '.') {
+            pos++;
+            if (!Digits()) {
+                return Fail("Malformed number");
+            }
+        }
+
+        if (Peek() == 'e' || Peek() == 'E') {
+            pos++;
+            if (Peek() == '+' || Peek() == '-') {
+                pos++;
+            }
+            if (!Digits()) {
+                return Fail("Malformed number");
+            }
+        }
+
+        uint32_t offset = charCount;
+        for (size_t i = begin; i < pos; ++i) {
+            Put(text[i]);
+        }
+
+        Set(index, Element::Type::Number, 0, 0, offset, charCount - offset);
+        return true;
+    }
+
+    constexpr bool Literal(uint32_t index, const char *token,
+                           Element::Type type) {
+        for (; *token; ++token, ++pos) {
+            if (Peek() != *token) {
+                return Fail("Invalid token");
+            }
+        }
+
+        Set(index, type, 0, 0, 0, 0);
+        return true;
+    }
+
+    // After an item, pos moves past the comma or the closing bracket
+    constexpr bool Separator(bool last, char close) {
+        SkipSpaces();
+        if (Peek() != (last ? close : ',')) {
+            return Fail(last ? "Container not closed after last item"
+                             : "Missing comma between items");
+        }
+
+        pos++;
+        return true;
+    }
+
+    // Children are stored next to each other, and keys point at their values
+    constexpr bool Container(uint32_t index, bool isObject) {
+        uint32_t count = CountItems();
+        uint32_t first = Reserve(count);
+        Set(index, isObject ? Element::Type::Object : Element::Type::Array,
+            first, count, 0, 0);
+
+        pos++;
+        if (count == 0) {
+            SkipSpaces();
+            return Separator(true, isObject ? '}' : ']');
+        }
+
+        for (uint32_t i = 0; i < count; ++i) {
+            if (!isObject) {
+                if (!Value(first + i)) {
+                    return false;
+                }
+            } else {
+                SkipSpaces();
+                if (Peek() != '\"') {
+                    return Fail("Key not found in object");
+                }
+
+                if (!String(first + i, Element::Type::Key)) {
+                    return false;
+                }
+
+                SkipSpaces();
+                if (Peek() != ':') {
+                    return Fail("Invalid char after key");
+                }
+                pos++;
+
+                uint32_t value = Reserve(1);
+                if (nodes) {
+                    nodes[first + i].firstChild = value;
+                }
+
+                if (!Value(value)) {
+                    return false;
+                }
+            }
+
+            if (!Separator(i + 1 == count, isObject ? '}' : ']')) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    constexpr bool Value(uint32_t index) {
+        SkipSpaces();
+
+        switch (Peek()) {
+        case '{':
+            return Container(index, true);
+        case '[':
+            return Container(index, false);
+        case '\"':
+            return String(index, Element::Type::String);
+        case 't':
+            return Literal(index, "true", Element::Type::True);
+        case 'f':
+            return Literal(index, "false", Element::Type::False);
+        case 'n':
+            return Literal(index, "null", Element::Type::Null);
+        case '-':
+        case '0':
+        case '1':
+        case '2':
+        case '3':
+        case '4':
+        case '5':
+        case '6':
+        case '7':
+        case '8':
+        case '9':
+            return Number(index);
+        case '\0':
+            if (AtEnd()) {
+                return Fail("Element not found before end of document");
+            }
+            return Fail("Unexpected char");
+        default:
+            return Fail("Unexpected char");
+        }
+    }
+
+  public:
+    constexpr EmbeddedParser(const char *_text, size_t _size,
+                             FlatNode *_nodes = nullptr,
+                             char *_strings = nullptr)
+        : text(_text), size(_size), nodes(_nodes), strings(_strings) {}
+
+    constexpr bool Parse() {
+        if (!Value(Reserve(1))) {
+            return false;
+        }
+
+        SkipSpaces();
+        return AtEnd() || Fail("Unexpected chars after value");
+    }
+
+    constexpr EmbeddedSize Size() const { return {nodeCount, charCount}; }
+};
+
+/**
+ * The table size needed for a literal
+ */
+template <size_t N>
+constexpr EmbeddedSize MeasureEmbedded(const char (&text)[N]) {
+    EmbeddedParser parser(text, N - 1);
+    parser.Parse();
+    return parser.Size();
+}
+
+template <size_t NodeCount, size_t CharCount, size_t N>
+constexpr EmbeddedDocument<NodeCount, CharCount>
+BuildEmbedded(const char (&text)[N]) {
+    EmbeddedDocument<NodeCount, CharCount> doc{};
+    EmbeddedParser parser(text, N - 1, doc.nodes, doc.strings);
+    parser.Parse();
+    return doc;
+}
+
+} // namespace StupidJSON
+
+/**
+ * Declare name as a document parsed from a string literal at compile time. A
+ * malformed literal fails to compile, with a call to EmbeddedSyntaxError in
+ * the error output that says what is wrong.
+ */
+#define STUPID_JSON_EMBED(name, literal)                                      \
+    static constexpr auto name = ::StupidJSON::BuildEmbedded<                 \
+        ::StupidJSON::MeasureEmbedded(literal).nodes,                          \
+        ::StupidJSON::MeasureEmbedded(literal).chars>(literal)
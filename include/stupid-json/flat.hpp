@@ -0,0 +1,149 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+
+#include <cstdint>
+
+namespace StupidJSON {
+
+/**
+ * A node in a position independent, read-only node table. Nodes refer to each
+ * other by index and to strings by offset into a separate string pool.
+ *
+ * The children of an object or array are stored next to each other, starting
+ * at firstChild, and always after their parent. For a key, firstChild is the
+ * index of its value.
+ */
+struct FlatNode {
+    uint32_t type; // Element::Type
+    uint32_t firstChild;
+    uint32_t childCount;
+    uint32_t strOffset; // Unescaped string for String and Key, text for Number
+    uint32_t strSize;
+};
+
+static_assert(sizeof(FlatNode) == 20, "FlatNode is part of the file format");
+
+/**
+ * A lightweight handle to a node in a flat node table, with a read API that
+ * mirrors Element. Since everything is unescaped up front no arena is needed.
+ */
+class FlatElement {
+    const FlatNode *nodes = nullptr;
+    const char *strings = nullptr;
+    uint32_t index = 0;
+
+    inline const FlatNode &Node() const { return nodes[index]; }
+    inline FlatElement At(uint32_t i) const { return {nodes, strings, i}; }
+
+  public:
+    FlatElement() = default;
+    FlatElement(const FlatNode *_nodes, const char *_strings, uint32_t _index)
+        : nodes(_nodes), strings(_strings), index(_index) {}
+
+    explicit operator bool() const { return nodes != nullptr; }
+
+    inline Element::Type Type() const {
+        return static_cast<Element::Type>(Node().type);
+    }
+
+    inline size_t ChildCount() const {
+        auto t = Type();
+        return t == Element::Type::Object || t == Element::Type::Array
+                   ? Node().childCount
+                   : 0;
+    }
+
+    inline StringView GetString() const {
+        auto t = Type();
+        if (t != Element::Type::String && t != Element::Type::Key) {
+            return {};
+        }
+
+        return {strings + Node().strOffset, Node().strSize};
+    }
+
+    template <typename T> bool GetInteger(T &val) const {
+        if (Type() != Element::Type::Number)
+            return false;
+
+        auto begin = strings + Node().strOffset;
+        auto end = begin + Node().strSize;
+        auto res = std::from_chars(begin, end, val);
+
+        return res.ec == std::errc() && res.ptr == end;
+    }
+
+    template <typename T> bool GetFloatingPoint(T &val) const {
+        if (Type() != Element::Type::Number)
+            return false;
+
+        auto begin = strings + Node().strOffset;
+        auto res = fast_float::from_chars(begin, begin + Node().strSize, val);
+
+        return res.ec == std::errc();
+    }
+
+    /**
+     * Arrays are contiguous, so this is constant time
+     */
+    inline FlatElement GetArrayIndex(uint32_t i) const {
+        if (Type() != Element::Type::Array || Node().childCount <= i) {
+            return {};
+        }
+
+        return At(Node().firstChild + i);
+    }
+
+    inline FlatElement FindKey(StringView name) const {
+        if (Type() != Element::Type::Object) {
+            return {};
+        }
+
+        auto first = Node().firstChild;
+        for (uint32_t i = first; i != first + Node().childCount; ++i) {
+            auto key = At(i);
+            if (key.GetString() == name) {
+                return key;
+            }
+        }
+
+        return {};
+    }
+
+    inline FlatElement FindChildElement(StringView name) const {
+        auto key = FindKey(name);
+        if (key)
+            return key.At(key.Node().firstChild);
+
+        return {};
+    }
+
+    template <typename L> bool IterateArray(L l) const {
+        if (Type() != Element::Type::Array) {
+            return false;
+        }
+
+        auto first = Node().firstChild;
+        for (uint32_t i = 0; i != Node().childCount; ++i) {
+            l(static_cast<size_t>(i), At(first + i));
+        }
+
+        return true;
+    }
+
+    template <typename L> bool IterateObject(L l) const {
+        if (Type() != Element::Type::Object) {
+            return false;
+        }
+
+        auto first = Node().firstChild;
+        for (uint32_t i = first; i != first + Node().childCount; ++i) {
+            auto key = At(i);
+            l(key.GetString(), key.At(key.Node().firstChild));
+        }
+
+        return true;
+    }
+};
+
+} // namespace StupidJSON
@@ -0,0 +1,21 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+
+namespace StupidJSON {
+
+/**
+ * Strip all whitespace outside of strings. Out needs room for in.Size()
+ * chars, and may be the same buffer as in. The input is not validated.
+ * Returns the size of the output.
+ */
+size_t Minify(StringView in, char *out);
+
+/**
+ * Write the input with one member or item per line, indented by indent
+ * spaces per level. At most outSize chars are written, and the returned
+ * size is the full size of the output, so a call with an empty buffer
+ * measures it. The input is not validated.
+ */
+size_t Reindent(StringView in, char *out, size_t outSize, int indent = 2);
+
+} // namespace StupidJSON
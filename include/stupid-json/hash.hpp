@@ -0,0 +1,14 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+
+#include <cstdint>
+
+namespace StupidJSON {
+
+/**
+ * 64 bit XXH64 hash of a buffer. The result is the same as the reference
+ * implementation on every platform.
+ */
+uint64_t Hash64(StringView data, uint64_t seed = 0);
+
+} // namespace StupidJSON
@@ -0,0 +1,57 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+
+#include <string>
+
+namespace StupidJSON {
+
+/**
+ * Replace removed bytes at offset with inserted
+ */
+struct TextEdit {
+    size_t offset;
+    size_t removed;
+    StringView inserted;
+};
+
+/**
+ * Owns a copy of a source text and the tree parsed from it, and keeps the
+ * tree up to date as the text is edited.
+ *
+ * An edit only re-parses the smallest container that encloses it, without
+ * touching the container's brackets. The new subtree replaces the old one in
+ * place, and the nodes after the edit are moved along with the text. The
+ * replaced nodes stay in the arena until it is reset, so documents that are
+ * edited for a long time should be reparsed into a fresh arena now and then.
+ *
+ * The tree must only be changed through ApplyEdit.
+ */
+class EditableDocument {
+    std::string body;
+    Element *root = nullptr;
+    size_t lastReparsed = 0;
+
+  public:
+    /**
+     * Copy text and parse it. On failure the root is an error element,
+     * unless it couldn't be allocated.
+     */
+    bool Parse(StringView text, ArenaAllocator &arena);
+
+    /**
+     * Apply an edit to the text and update the tree. If the edited text
+     * doesn't parse, the root becomes the error element as from ParseBody,
+     * and the next edit parses the whole text again.
+     */
+    bool ApplyEdit(const TextEdit &edit, ArenaAllocator &arena);
+
+    inline Element *Root() const { return root; }
+    inline StringView Source() const { return {body.data(), body.size()}; }
+
+    /**
+     * Bytes of text parsed by the last Parse or ApplyEdit
+     */
+    inline size_t LastReparsedSize() const { return lastReparsed; }
+};
+
+} // namespace StupidJSON
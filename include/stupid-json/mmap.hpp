@@ -0,0 +1,40 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+
+namespace StupidJSON {
+
+/**
+ * A read-only memory mapping of a whole file, unmapped on destruction.
+ */
+class MappedFile {
+    void *data = nullptr;
+    size_t size = 0;
+
+  public:
+    enum class Access {
+        Random,     // Pages are touched in any order
+        Sequential, // Pages are read front to back once, as when parsing
+    };
+
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile(MappedFile &&) noexcept;
+    ~MappedFile();
+
+    MappedFile &operator=(MappedFile &&) noexcept;
+
+    /**
+     * Map a file, replacing any previous mapping. Empty files can't be mapped
+     * and fail to open.
+     */
+    bool Open(const char *path, Access access = Access::Random);
+    void Close();
+
+    inline bool IsOpen() const { return data != nullptr; }
+    inline size_t Size() const { return size; }
+    inline StringView View() const {
+        return {static_cast<const char *>(data), size};
+    }
+};
+
+} // namespace StupidJSON
@@ -0,0 +1,24 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+
+#include <ostream>
+
+namespace StupidJSON {
+
+/**
+ * Write the tree below root with the same output as Element::Serialize,
+ * rendering large arrays and objects on several threads.
+ *
+ * The output size of every subtree is measured first, and containers that
+ * are too large for a single thread are split into ranges of children. Each
+ * range is rendered into a buffer of its own, and the buffers are written to
+ * s in order as they complete. Small documents are rendered on the calling
+ * thread.
+ *
+ * The tree isn't modified, strings without an escaped version are escaped
+ * straight into the output, so other threads may read the tree meanwhile.
+ * threads is the number of workers, 0 uses every core.
+ */
+bool SerializeParallel(Element *root, std::ostream &s, unsigned threads = 0);
+
+} // namespace StupidJSON
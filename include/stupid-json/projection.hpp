@@ -0,0 +1,55 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+
+#include <string>
+#include <vector>
+
+namespace StupidJSON {
+
+// A set of key paths to keep while parsing, given as JSON Pointers (RFC 6901)
+// such as "/user/screen_name". Members of an object that are not on any path
+// are skipped without being parsed or allocated, and the value at the end of
+// a path is kept as a whole.
+//
+// Arrays are transparent, the projection of an array applies to each of its
+// items, so "/statuses/id" keeps the id of every status. Like in Query, a
+// token that is exactly '*' matches every key.
+class Projection {
+  public:
+    struct Node {
+        std::string key; // Unescaped reference token
+        std::vector<Node> children;
+        bool keepAll = false; // A path ends here, keep the whole value
+        bool wildcard = false;
+    };
+
+  private:
+    Node root;
+
+  public:
+    /**
+     * Add a path, returns false if it is malformed. An empty pointer keeps
+     * the whole document.
+     */
+    bool Add(StringView pointer);
+
+    /**
+     * Remove all paths, which makes every object parse as empty
+     */
+    void Clear();
+
+    /**
+     * Returns nullptr if the whole document is kept
+     */
+    inline const Node *Root() const { return root.keepAll ? nullptr : &root; }
+
+    /**
+     * Find the child of node that a raw, still escaped, key projects to.
+     * Returns nullptr if the member should be skipped. An exact match is
+     * preferred over a wildcard, and keeps everything the wildcard would.
+     */
+    static const Node *Match(const Node *node, StringView raw,
+                             ArenaAllocator &arena);
+};
+
+} // namespace StupidJSON
@@ -0,0 +1,65 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+
+#include <string>
+#include <vector>
+
+namespace StupidJSON {
+
+// A compiled JSON Pointer (RFC 6901), such as "/features/0/geometry".
+//
+// As an extension, a reference token consisting of a single '*' matches every
+// member of an object or every item of an array, so "/statuses/*/user/id"
+// selects the user id of every status.
+class Query {
+    struct Segment {
+        std::string key; // Unescaped reference token
+        uint32_t index;  // Only valid if isIndex is set
+        bool isIndex;
+        bool wildcard;
+    };
+
+    std::vector<Segment> segments;
+
+    static const char *MatchValue(const Segment *seg, const Segment *segEnd,
+                                  const char *begin, const char *end,
+                                  ArenaAllocator &arena,
+                                  std::vector<Element *> &hits);
+    static const char *MatchObject(const Segment *seg, const Segment *segEnd,
+                                   const char *begin, const char *end,
+                                   ArenaAllocator &arena,
+                                   std::vector<Element *> &hits);
+    static const char *MatchArray(const Segment *seg, const Segment *segEnd,
+                                  const char *begin, const char *end,
+                                  ArenaAllocator &arena,
+                                  std::vector<Element *> &hits);
+    static void MatchElement(const Segment *seg, const Segment *segEnd,
+                             Element *elem, ArenaAllocator &arena,
+                             std::vector<Element *> &hits);
+
+  public:
+    /**
+     * Compile a pointer, returns false if it is malformed. An empty pointer
+     * refers to the whole document.
+     */
+    bool Compile(StringView pointer);
+
+    /**
+     * Evaluate the query directly against a source buffer. Only matching keys
+     * and indices are descended into, everything else is skipped without
+     * being parsed or validated. Each hit is parsed into the arena and
+     * appended to hits.
+     */
+    bool Evaluate(StringView body, ArenaAllocator &arena,
+                  std::vector<Element *> &hits) const;
+
+    /**
+     * Evaluate the query against an already parsed tree.
+     */
+    void Evaluate(Element *root, ArenaAllocator &arena,
+                  std::vector<Element *> &hits) const;
+
+    inline size_t Depth() const { return segments.size(); }
+};
+
+} // namespace StupidJSON
@@ -0,0 +1,220 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+#include "stupid-json/tokenizer.hpp"
+
+namespace StupidJSON {
+
+/**
+ * Handler with an empty implementation of every event. Derive from it and
+ * hide only the events that are needed, the parser calls the handler through
+ * its own type, so nothing is virtual.
+ *
+ * Every event returns false to stop parsing. Keys and strings are the raw,
+ * still escaped, text from the source, use UnescapeString to get the clean
+ * version. Numbers are the source text as well.
+ */
+struct SaxHandler {
+    inline bool StartObject() { return true; }
+    inline bool Key(StringView) { return true; }
+    inline bool EndObject(size_t) { return true; }
+    inline bool StartArray() { return true; }
+    inline bool EndArray(size_t) { return true; }
+    inline bool String(StringView) { return true; }
+    inline bool Number(StringView) { return true; }
+    inline bool Bool(bool) { return true; }
+    inline bool Null() { return true; }
+};
+
+namespace Sax {
+
+template <typename H> bool ReadValue(const char *&it, const char *end, H &h);
+
+inline bool ReadToken(const char *&it, const char *end, StringView token) {
+    if (static_cast<size_t>(end - it) < token.Size() ||
+        memcmp(it, token.begin, token.Size()) != 0) {
+        return false;
+    }
+
+    it += token.Size();
+    return true;
+}
+
+template <typename H> bool ReadObject(const char *&it, const char *end, H &h) {
+    using namespace Tokenizer;
+
+    if (!h.StartObject()) {
+        return false;
+    }
+
+    it = FwdSpaces(it + 1, end);
+    if (it != end && *it == '}') {
+        it++;
+        return h.EndObject(0);
+    }
+
+    size_t count = 0;
+
+    while (it != end) {
+        if (*it != '\"') {
+            return false;
+        }
+
+        auto keyEnd = SkipString(it + 1, end);
+        if (keyEnd == end || !h.Key({it + 1, keyEnd})) {
+            return false;
+        }
+
+        it = FwdSpaces(keyEnd + 1, end);
+        if (it == end || *it != ':') {
+            return false;
+        }
+
+        it++;
+        if (!ReadValue(it, end, h)) {
+            return false;
+        }
+
+        count++;
+
+        it = FwdSpaces(it, end);
+        if (it == end) {
+            return false;
+        }
+
+        if (*it == '}') {
+            it++;
+            return h.EndObject(count);
+        }
+
+        if (*it != ',') {
+            return false;
+        }
+
+        it = FwdSpaces(it + 1, end);
+    }
+
+    return false;
+}
+
+template <typename H> bool ReadArray(const char *&it, const char *end, H &h) {
+    using namespace Tokenizer;
+
+    if (!h.StartArray()) {
+        return false;
+    }
+
+    it = FwdSpaces(it + 1, end);
+    if (it != end && *it == ']') {
+        it++;
+        return h.EndArray(0);
+    }
+
+    size_t count = 0;
+
+    while (it != end) {
+        if (!ReadValue(it, end, h)) {
+            return false;
+        }
+
+        count++;
+
+        it = FwdSpaces(it, end);
+        if (it == end) {
+            return false;
+        }
+
+        if (*it == ']') {
+            it++;
+            return h.EndArray(count);
+        }
+
+        if (*it != ',') {
+            return false;
+        }
+
+        it++;
+    }
+
+    return false;
+}
+
+template <typename H> bool ReadValue(const char *&it, const char *end, H &h) {
+    using namespace Tokenizer;
+
+    it = FwdSpaces(it, end);
+    if (it == end) {
+        return false;
+    }
+
+    switch (*it) {
+    case '\"': {
+        auto strEnd = SkipString(it + 1, end);
+        if (strEnd == end || !h.String({it + 1, strEnd})) {
+            return false;
+        }
+
+        it = strEnd + 1;
+        return true;
+    }
+
+    case '{':
+        return ReadObject(it, end, h);
+
+    case '[':
+        return ReadArray(it, end, h);
+
+    case 'n':
+        return ReadToken(it, end, "null") && h.Null();
+
+    case 't':
+        return ReadToken(it, end, "true") && h.Bool(true);
+
+    case 'f':
+        return ReadToken(it, end, "false") && h.Bool(false);
+
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+    case '-': {
+        auto numEnd = ScanNumber(it, end);
+        if (!numEnd || !h.Number({it, numEnd})) {
+            return false;
+        }
+
+        it = numEnd;
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+} // namespace Sax
+
+/**
+ * Parse a single value and report it to the handler as a sequence of events,
+ * without building elements or allocating. Term is set past the value, or to
+ * where parsing stopped if the document is malformed or the handler returned
+ * false.
+ */
+template <typename H>
+bool ParseEvents(StringView body, H &handler, const char **term = nullptr) {
+    const char *it = body.begin;
+    bool res = Sax::ReadValue(it, body.end, handler);
+
+    if (term) {
+        *term = it;
+    }
+
+    return res;
+}
+
+} // namespace StupidJSON
@@ -0,0 +1,22 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+
+namespace StupidJSON {
+
+/**
+ * Write the tree below root to a file descriptor, with the same output as
+ * Element::Serialize.
+ *
+ * Instead of copying the document through a stream, the output is gathered
+ * as a list of slices pointing at the source buffer and the arena, and
+ * written with writev. Only punctuation, indentation and short tokens are
+ * copied into a small buffer. Strings that haven't been escaped yet are
+ * escaped into the arena.
+ *
+ * Blocking descriptors are expected, partial writes are continued. Returns
+ * false if the tree is malformed or a write fails, in which case part of the
+ * document may have been written already.
+ */
+bool SerializeToFd(Element *root, ArenaAllocator &arena, int fd);
+
+} // namespace StupidJSON
@@ -0,0 +1,99 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace StupidJSON {
+
+// The keys of recently parsed objects, in order, so that parsing records
+// that share a schema can check each key with a single memcmp instead of
+// scanning and unescaping it. Pass it in ParseOptions::shape and reuse it for
+// every record of a stream.
+//
+// Each object position in the document has its own node, and like
+// projections, arrays are transparent so that their items share one. A node
+// remembers a few key orders, so that streams mixing several kinds of
+// records, or records with optional keys, don't have to learn on every
+// record. The first key picks an order, and a key that differs moves on to
+// another order with the same keys before it. Records that leave out the
+// last keys of an order still match. When an object doesn't match, the rest
+// of it is parsed as usual and its keys extend the order they go on from,
+// or take a free or the oldest order. Only keys learned with a container
+// value get a node for the objects below.
+//
+// Learning writes to the shape, so it must not be shared between threads
+// that parse at the same time. Shapes are not used inside projected objects.
+class Shape {
+  public:
+    struct Node;
+
+    struct Key {
+        std::string raw; // As in the source, including both quotes
+        bool escaped = false;
+        std::unique_ptr<Node> child; // Objects below this key, if learned
+
+        /**
+         * The node for objects in the value of this key, created if needed
+         */
+        Node *Child();
+    };
+
+    using Keys = std::vector<Key>;
+
+    static const size_t maxOrders = 4;
+
+    struct Node {
+        std::vector<Keys> orders;
+        size_t replace = 0; // Next order to overwrite once all are taken
+        // Objects whose keys all matched the start of an order, and objects
+        // that had to be learned. Counts of children that are dropped are
+        // added here.
+        size_t hits = 0;
+        size_t misses = 0;
+
+        /**
+         * The order whose first key is the quoted string at begin, if any
+         */
+        Keys *Select(const char *begin, const char *end);
+
+        /**
+         * Another order that starts with the first index keys of keys and
+         * goes on with the quoted string at begin, if any
+         */
+        Keys *Switch(const Keys *keys, size_t index, const char *begin,
+                     const char *end);
+
+        /**
+         * Objects whose keys rarely repeat cost more to learn than they save,
+         * so nodes that mostly miss keep the orders they have
+         */
+        inline bool Learning() const { return misses <= 2 * hits + 8; }
+
+        /**
+         * Replace an order with the keys of object. Children of keys that
+         * are still at the same position are kept.
+         */
+        void Learn(const Element *object);
+    };
+
+  private:
+    Node root;
+
+  public:
+    inline Node *Root() { return &root; }
+
+    /**
+     * Forget everything that was learned
+     */
+    void Clear();
+
+    /**
+     * Totals over every node since the last Clear
+     */
+    size_t Hits() const;
+    size_t Misses() const;
+};
+
+} // namespace StupidJSON
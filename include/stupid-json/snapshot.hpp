@@ -0,0 +1,62 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+#include "stupid-json/flat.hpp"
+#include "stupid-json/mmap.hpp"
+
+#include <ostream>
+
+namespace StupidJSON {
+
+/**
+ * A relocatable binary image of a parsed document. The image is a header,
+ * followed by a FlatNode table and a pool of unescaped strings, so it can be
+ * mapped straight from disk and shared between processes.
+ *
+ * The image uses the byte order of the machine that wrote it, and loading an
+ * image from another byte order fails validation.
+ */
+class Snapshot {
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint64_t nodeCount;
+        uint64_t stringsSize;
+    };
+
+    MappedFile file;
+    const FlatNode *nodes = nullptr;
+    const char *strings = nullptr;
+
+  public:
+    /**
+     * Write the tree below root as a snapshot. Strings that haven't been
+     * unescaped yet are unescaped into the arena.
+     */
+    static bool Write(Element *root, ArenaAllocator &arena, std::ostream &s);
+
+    /**
+     * Map a snapshot file and validate it. The snapshot stays mapped until
+     * this object is destroyed or another snapshot is opened.
+     */
+    bool Open(const char *path);
+
+    /**
+     * Validate and use a snapshot that is already in memory. The buffer must
+     * be 4 byte aligned and outlive this object.
+     */
+    bool Load(StringView buffer);
+
+    /**
+     * Returns an empty handle if no snapshot is loaded
+     */
+    inline FlatElement Root() const {
+        if (!nodes) {
+            return {};
+        }
+
+        return {nodes, strings, 0};
+    }
+};
+
+} // namespace StupidJSON
@@ -0,0 +1,552 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/**
+ * Low level scanning helpers shared by the parsers and writers. These work
+ * directly on the buffers they are given and never allocate.
+ */
+namespace StupidJSON::Tokenizer {
+
+inline bool isSpace(char c) {
+    static const bool table[256] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    return table[static_cast<unsigned char>(c)];
+}
+
+inline bool isDigit(char c) {
+    static const bool table[256] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    return table[static_cast<unsigned char>(c)];
+}
+
+inline int8_t GetHexValue(char c) {
+    static const int8_t table[] = {
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0,  1,  2,  3,  4,  5,
+        6,  7,  8,  9,  -1, -1, -1, -1, -1, -1, -1, 10, 11, 12, 13, 14, 15, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1,
+    };
+    return table[static_cast<unsigned char>(c)];
+}
+
+inline char GetHexChar(char v) {
+    static const char table[] = {
+        '0', '1', '2', '3', '4', '5', '6', '7',
+        '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+    };
+    return table[static_cast<unsigned char>(v)];
+}
+
+/**
+ * Returns the char that follows the backslash when c is escaped in a JSON
+ * string, 'u' for control chars without a short form, or 0 if c is written
+ * as is.
+ */
+inline char GetEscapeChar(char c) {
+    static const char table[256] = {
+        'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r',
+        'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+        'u', 'u', 'u', 'u', 0, 0, '\"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    };
+    return table[static_cast<unsigned char>(c)];
+}
+
+/**
+ * Size of a clean string once it is escaped
+ */
+inline size_t EscapedSize(const char *begin, const char *end) {
+    size_t size = 0;
+    while (begin != end) {
+        char e = GetEscapeChar(*(begin++));
+        size += e == 0 ? 1 : e == 'u' ? 6 : 2;
+    }
+
+    return size;
+}
+
+/**
+ * Escape a clean string into out, which must have room for EscapedSize
+ * chars. Returns the end of the written string.
+ */
+inline char *EscapeChars(const char *begin, const char *end, char *out) {
+    while (begin != end) {
+        char c = *(begin++);
+        char e = GetEscapeChar(c);
+
+        if (e == 0) {
+            *(out++) = c;
+            continue;
+        }
+
+        *(out++) = '\\';
+        *(out++) = e;
+
+        if (e == 'u') {
+            *(out++) = '0';
+            *(out++) = '0';
+            *(out++) = GetHexChar((c >> 4) & 0xf);
+            *(out++) = GetHexChar(c & 0xf);
+        }
+    }
+
+    return out;
+}
+
+/**
+ * Check a single escape sequence, begin should point at the backslash. A high
+ * surrogate must be followed by an escaped low surrogate, the same as
+ * UnescapeString requires. Returns the end of the sequence, or nullptr if it
+ * is invalid.
+ */
+inline const char *ScanEscape(const char *begin, const char *end) {
+    if (end - begin < 2) {
+        return nullptr;
+    }
+
+    switch (begin[1]) {
+    case '\"':
+    case '\\':
+    case '/':
+    case 'b':
+    case 'f':
+    case 'n':
+    case 'r':
+    case 't':
+        return begin + 2;
+    case 'u':
+        break;
+    default:
+        return nullptr;
+    }
+
+    auto readHex = [end](const char *it, int &u) {
+        if (end - it < 4) {
+            return false;
+        }
+
+        u = 0;
+        for (int i = 0; i < 4; ++i) {
+            int8_t val = GetHexValue(it[i]);
+            if (val == -1) {
+                return false;
+            }
+
+            u = (u << 4) | val;
+        }
+
+        return true;
+    };
+
+    int u;
+    if (!readHex(begin + 2, u)) {
+        return nullptr;
+    }
+
+    begin += 6;
+    if (u < 0xD800 || u > 0xDBFF) {
+        return begin;
+    }
+
+    if (end - begin < 2 || begin[0] != '\\' || begin[1] != 'u' ||
+        !readHex(begin + 2, u) || u < 0xDC00 || u > 0xDFFF) {
+        return nullptr;
+    }
+
+    return begin + 6;
+}
+
+// Helpers to test 8 chars at a time in a 64 bit word
+
+inline uint64_t LoadWord(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * Non-zero if any byte of v equals c
+ */
+inline uint64_t SwarHasByte(uint64_t v, uint8_t c) {
+    uint64_t x = v ^ (0x0101010101010101ull * c);
+    return (x - 0x0101010101010101ull) & ~x & 0x8080808080808080ull;
+}
+
+/**
+ * Non-zero if any byte of v is less than n, n must be at most 128
+ */
+inline uint64_t SwarHasLess(uint64_t v, uint8_t n) {
+    return (v - 0x0101010101010101ull * n) & ~v & 0x8080808080808080ull;
+}
+
+inline const char *FwdSpaces(const char *begin, const char *end) {
+    while (begin != end && isSpace(*begin))
+        ++begin;
+
+    return begin;
+}
+
+inline const char *FwdCommaOrTerm(const char *begin, const char *end,
+                                  char term) {
+    begin = FwdSpaces(begin, end);
+    if (begin == end || *begin != ',' && *begin != term) {
+        return end;
+    }
+
+    if (*begin == ',') {
+        begin++;
+    }
+
+    return FwdSpaces(begin, end);
+}
+
+inline const char *FindChar(const char *begin, const char *end, char c) {
+    while (begin != end && *begin != c) {
+        begin++;
+    }
+
+    return begin;
+}
+
+inline size_t CountChar(const char *begin, const char *end, char c) {
+    size_t count = 0;
+    while (begin != end) {
+        if (*begin == c)
+            count++;
+
+        begin++;
+    }
+
+    return count;
+}
+
+inline const char *ConsumeString(const char *begin, const char *end) {
+    auto it = FindChar(begin, end, '\"');
+    if (it == begin || it == end) {
+        return it;
+    }
+
+    while (it != end && *(it - 1) == '\\') {
+        it = FindChar(it + 1, end, '\"');
+    }
+
+    return it;
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define STUPID_JSON_SWAR_DIGITS 1
+#endif
+
+#ifdef STUPID_JSON_SWAR_DIGITS
+/**
+ * Number of digits at the start of an 8 char word
+ */
+inline int LeadingDigits(uint64_t w) {
+    // Each digit byte becomes 0x33, and the +6 can only carry out of a byte
+    // that is not a digit, which doesn't affect the bytes before it
+    uint64_t x = (w & 0xF0F0F0F0F0F0F0F0ull) |
+                 (((w + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4);
+    uint64_t y = x ^ 0x3333333333333333ull;
+
+    // Set the top bit of every byte that is not a digit
+    uint64_t nonDigit =
+        (((y & 0x7F7F7F7F7F7F7F7Full) + 0x7F7F7F7F7F7F7F7Full) | y) &
+        0x8080808080808080ull;
+
+    return nonDigit == 0 ? 8 : __builtin_ctzll(nonDigit) / 8;
+}
+
+/**
+ * Value of 8 digits in a word
+ */
+inline uint32_t EightDigitsValue(uint64_t w) {
+    w -= 0x3030303030303030ull;
+    w = (w * 10) + (w >> 8);
+    w = (((w & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+         (((w >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >>
+        32;
+    return static_cast<uint32_t>(w);
+}
+#endif
+
+inline const char *SkipDigits(const char *begin, const char *end) {
+#ifdef STUPID_JSON_SWAR_DIGITS
+    while (end - begin >= 8) {
+        int count = LeadingDigits(LoadWord(begin));
+        begin += count;
+        if (count != 8) {
+            return begin;
+        }
+    }
+#endif
+
+    while (begin != end && isDigit(*begin)) {
+        begin++;
+    }
+
+    return begin;
+}
+
+/**
+ * What ScanNumber found out about a number while scanning it
+ */
+struct NumberScan {
+    int64_t integer; // Only valid if isInteger is set
+    bool isInteger;  // No fraction or exponent, fits in an int64_t and is
+                     // not -0, which only a double can hold
+};
+
+/**
+ * Find the end of a number following the RFC 8259 grammar, begin should point
+ * at a digit or a '-'. Returns nullptr if the number is malformed. The
+ * number ends at the first char that can't continue it, checking what comes
+ * after is up to the caller.
+ *
+ * If scan is given, integers are accumulated during the scan as well.
+ */
+inline const char *ScanNumber(const char *begin, const char *end,
+                              NumberScan *scan = nullptr) {
+    auto it = begin;
+    bool negative = *it == '-';
+    if (negative) {
+        it++;
+    }
+
+    if (it == end || !isDigit(*it)) {
+        return nullptr;
+    }
+
+    auto intBegin = it;
+    if (*it == '0') {
+        it++;
+
+        // No leading zeros
+        if (it != end && isDigit(*it)) {
+            return nullptr;
+        }
+    } else {
+        it = SkipDigits(it, end);
+    }
+
+    auto intEnd = it;
+    bool isInteger = true;
+
+    if (it != end && *it == '.') {
+        auto fracEnd = SkipDigits(++it, end);
+        if (fracEnd == it) {
+            return nullptr;
+        }
+
+        it = fracEnd;
+        isInteger = false;
+    }
+
+    if (it != end && (*it == 'e' || *it == 'E')) {
+        if (++it != end && (*it == '+' || *it == '-')) {
+            it++;
+        }
+
+        auto expEnd = SkipDigits(it, end);
+        if (expEnd == it) {
+            return nullptr;
+        }
+
+        it = expEnd;
+        isInteger = false;
+    }
+
+    if (!scan) {
+        return it;
+    }
+
+    // 19 digits always fit in 64 bits unsigned, more never fit signed
+    scan->isInteger = isInteger && intEnd - intBegin <= 19;
+    if (!scan->isInteger) {
+        return it;
+    }
+
+    uint64_t value = 0;
+    auto d = intBegin;
+
+#ifdef STUPID_JSON_SWAR_DIGITS
+    while (intEnd - d >= 8) {
+        value = value * 100000000 + EightDigitsValue(LoadWord(d));
+        d += 8;
+    }
+#endif
+
+    while (d != intEnd) {
+        value = value * 10 + (*(d++) - '0');
+    }
+
+    uint64_t limit = uint64_t(INT64_MAX) + (negative ? 1 : 0);
+    if (value > limit || (negative && value == 0)) {
+        scan->isInteger = false;
+    } else {
+        scan->integer = negative ? static_cast<int64_t>(0 - value)
+                                 : static_cast<int64_t>(value);
+    }
+
+    return it;
+}
+
+/**
+ * Find the closing quote of a string, honoring escapes. Begin should point
+ * past the opening quote. Returns end if the string is not terminated.
+ */
+inline const char *SkipString(const char *begin, const char *end) {
+    while (begin != end) {
+        if (*begin == '\"') {
+            return begin;
+        }
+
+        if (*begin == '\\' && ++begin == end) {
+            break;
+        }
+
+        begin++;
+    }
+
+    return end;
+}
+
+/**
+ * Skip past an object or array by matching brackets, without validating the
+ * content. Begin should point at the opening bracket. Returns nullptr if the
+ * container is not closed before end.
+ */
+inline const char *SkipContainer(const char *begin, const char *end) {
+    size_t depth = 0;
+
+    while (begin != end) {
+        switch (*begin) {
+        case '\"':
+            begin = SkipString(begin + 1, end);
+            if (begin == end) {
+                return nullptr;
+            }
+            break;
+        case '{':
+        case '[':
+            depth++;
+            break;
+        case '}':
+        case ']':
+            if (--depth == 0) {
+                return begin + 1;
+            }
+            break;
+        default:
+            break;
+        }
+
+        begin++;
+    }
+
+    return nullptr;
+}
+
+/**
+ * Skip past a single value of any type, without validating it. Begin should
+ * point at the first char of the value. Returns nullptr if the value is
+ * truncated.
+ */
+inline const char *SkipValue(const char *begin, const char *end) {
+    if (begin == end) {
+        return nullptr;
+    }
+
+    switch (*begin) {
+    case '\"':
+        begin = SkipString(begin + 1, end);
+        return begin == end ? nullptr : begin + 1;
+    case '{':
+    case '[':
+        return SkipContainer(begin, end);
+    default:
+        break;
+    }
+
+    auto it = begin;
+    while (it != end && !isSpace(*it) && *it != ',' && *it != '}' &&
+           *it != ']') {
+        it++;
+    }
+
+    return it == begin ? nullptr : it;
+}
+
+/**
+ * Decode a JSON Pointer reference token (RFC 6901) into key, where "~0" is a
+ * '~' and "~1" a '/'. Returns false on any other use of '~'.
+ */
+inline bool DecodePointerToken(const char *begin, const char *end,
+                               std::string &key) {
+    key.clear();
+    key.reserve(end - begin);
+
+    for (auto c = begin; c != end; ++c) {
+        if (*c != '~') {
+            key.push_back(*c);
+            continue;
+        }
+
+        if (++c == end) {
+            return false;
+        }
+
+        if (*c == '0') {
+            key.push_back('~');
+        } else if (*c == '1') {
+            key.push_back('/');
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+} // namespace StupidJSON::Tokenizer
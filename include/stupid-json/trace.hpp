@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+
+/**
+ * Tracing hooks in the parse and lookup paths. They are compiled out unless
+ * STUPID_JSON_TRACE is defined, which the STUPID_JSON_TRACE CMake option does
+ * for the library and everything linking to it. When enabled, the program
+ * must provide definitions for all of the functions below.
+ *
+ * Hooks are called synchronously on the parsing thread and should be cheap,
+ * for example only recording when a sampled request is being traced.
+ */
+
+#ifdef STUPID_JSON_TRACE
+
+namespace StupidJSON {
+
+struct Element;
+class ArenaAllocator;
+
+namespace Trace {
+
+// A call to ParseBody started or finished on root
+void ParseBegin(const Element *root, const char *begin, const char *end);
+void ParseEnd(const Element *root, bool success);
+
+// An object or array starting at pos is being parsed
+void ContainerEnter(const Element *container, const char *pos);
+void ContainerExit(const Element *container, bool success);
+
+// The arena allocated a new block of element or string storage
+void BlockAllocated(const ArenaAllocator *arena, size_t bytes);
+
+// A string contains escapes and is being unescaped into the arena
+void Unescape(const char *begin, const char *end);
+
+// FindKey is about to scan the keys of object
+void FindKey(const Element *object, const char *nameBegin,
+             const char *nameEnd);
+
+} // namespace Trace
+} // namespace StupidJSON
+
+#define STUPID_JSON_TRACE_HOOK(hook, ...)                                      \
+    ::StupidJSON::Trace::hook(__VA_ARGS__)
+
+#else
+
+#define STUPID_JSON_TRACE_HOOK(hook, ...) ((void)0)
+
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+
+namespace StupidJSON {
+
+enum class ValidateError {
+    None = 0,
+    UnexpectedEnd,
+    UnexpectedChar,
+    InvalidString,
+    InvalidEscape,
+    InvalidNumber,
+    InvalidLiteral,
+    TooDeep,
+    TrailingChars,
+};
+
+struct ValidateResult {
+    ValidateError error;
+    size_t offset; // Where the error was found
+
+    explicit operator bool() const { return error == ValidateError::None; }
+
+    const char *Message() const;
+};
+
+/**
+ * Containers can be nested this deep before validation fails
+ */
+static const size_t validateMaxDepth = 4096;
+
+/**
+ * Check that body is a single valid JSON value, optionally surrounded by
+ * whitespace, without building elements or allocating.
+ *
+ * Strings and numbers follow the same rules as ParseBody. The structure is
+ * checked strictly though, so trailing commas and unescaped control chars in
+ * strings are rejected.
+ */
+ValidateResult Validate(StringView body);
+
+} // namespace StupidJSON
@@ -0,0 +1,116 @@
+#pragma once
+#include "stupid-json/arena.hpp"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace StupidJSON {
+
+/**
+ * Writes compact JSON directly from a sequence of calls, without building a
+ * tree of elements first. Output collects in an internal buffer, which is
+ * either read back with View or flushed to a stream whenever it grows past the
+ * flush size. The buffer keeps its capacity across Reset, so a writer can be
+ * reused for many documents without allocating.
+ *
+ * Several top level values are separated by newlines, which makes it usable
+ * for NDJSON as well. Calls that would produce invalid JSON, such as a value
+ * in an object without a key, put the writer in an error state and return
+ * false from then on.
+ */
+class Writer {
+    std::string buffer;
+    std::ostream *sink = nullptr;
+    size_t flushSize = 0;
+
+    std::vector<bool> stack; // True for objects
+    bool first = true;       // No separator needed before the next item
+    bool afterKey = false;
+    const char *error = nullptr;
+
+    bool Fail(const char *msg);
+    bool BeginValue();
+    bool BeginKey();
+    void Put(char c);
+    void Put(StringView str);
+    void PutEscaped(StringView str);
+    bool MaybeFlush();
+
+  public:
+    Writer() = default;
+
+    /**
+     * Write to a stream, flushing each time more than flushSize bytes are
+     * buffered
+     */
+    explicit Writer(std::ostream &s, size_t flushSize = 64 * 1024);
+
+    bool BeginObject();
+    bool EndObject();
+    bool BeginArray();
+    bool EndArray();
+
+    /**
+     * Write a key in an object, the name is escaped as needed
+     */
+    bool Key(StringView name);
+
+    /**
+     * Write a string value, the string is escaped as needed
+     */
+    bool String(StringView str);
+
+    template <typename T> bool Number(T val);
+
+    bool Bool(bool val);
+    bool Null();
+
+    /**
+     * Write an existing element and everything below it
+     */
+    bool Value(Element *elem, ArenaAllocator &arena);
+
+    /**
+     * Write everything buffered to the stream. Without a stream this does
+     * nothing.
+     */
+    bool Flush();
+
+    /**
+     * Clear the output and the nesting state, but keep the buffer capacity
+     */
+    void Reset();
+
+    /**
+     * The output that hasn't been flushed yet
+     */
+    inline StringView View() const { return {buffer.data(), buffer.size()}; }
+
+    /**
+     * True when no container is left open
+     */
+    inline bool Complete() const { return !error && stack.empty(); }
+
+    /**
+     * Returns nullptr unless a call failed
+     */
+    inline const char *Error() const { return error; }
+};
+
+template <typename T> bool Writer::Number(T val) {
+    if (!BeginValue()) {
+        return false;
+    }
+
+    char buf[64];
+    char *numEnd = FormatNumber(val, buf, buf + sizeof(buf));
+    if (!numEnd) {
+        return Fail("Failed to format number");
+    }
+
+    Put({buf, numEnd});
+    return MaybeFlush();
+}
+
+} // namespace StupidJSON
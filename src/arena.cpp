@@ -1,4 +1,7 @@
 #include "stupid-json/arena.hpp"
+#include "stupid-json/projection.hpp"
+#include "stupid-json/shape.hpp"
+#include "stupid-json/tokenizer.hpp"
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
@@ -6,167 +9,7 @@
 
 namespace StupidJSON {
 
-static inline bool isSpace(char c) {
-    static const bool table[256] = {
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-    return table[c];
-}
-
-static inline bool isDigit(char c) {
-    static const bool table[256] = {
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-    return table[c];
-}
-
-static inline bool isDigitOrDot(char c) {
-    static const bool table[256] = {
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0,
-        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-    return table[c];
-}
-
-/*
-static inline std::array<int8_t, 256> GenerateHexTable() {
-    std::array<int8_t, 256> res;
-    res.fill(-1);
-    res['0'] = 0;
-    res['1'] = 1;
-    res['2'] = 2;
-    res['3'] = 3;
-    res['4'] = 4;
-    res['5'] = 5;
-    res['6'] = 6;
-    res['7'] = 7;
-    res['8'] = 8;
-    res['9'] = 9;
-    res['a'] = res['A'] = 10;
-    res['b'] = res['B'] = 11;
-    res['c'] = res['C'] = 12;
-    res['d'] = res['D'] = 13;
-    res['e'] = res['E'] = 14;
-    res['f'] = res['F'] = 15;
-
-    std::cout << std::endl;
-    for (int c : res) {
-        std::cout << c << ", ";
-    }
-    std::cout << std::endl;
-    return res;
-}
-*/
-
-static inline int8_t GetHexValue(char c) {
-    // static const auto table = GenerateHexTable();
-    static const int8_t table[] = {
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0,  1,  2,  3,  4,  5,
-        6,  7,  8,  9,  -1, -1, -1, -1, -1, -1, -1, 10, 11, 12, 13, 14, 15, -1,
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1, -1, -1, -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1,
-    };
-    return table[c];
-}
-
-static inline char GetHexChar(char v) {
-    char table[] = {
-        '0', '1', '2', '3', '4', '5', '6', '7',
-        '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
-    };
-    return table[v];
-}
-
-static inline const char *FwdSpaces(const char *begin, const char *end) {
-    while (begin != end && isSpace(*begin))
-        ++begin;
-
-    return begin;
-}
-
-static inline const char *FwdCommaOrTerm(const char *begin, const char *end,
-                                         char term) {
-    begin = FwdSpaces(begin, end);
-    if (begin == end || *begin != ',' && *begin != term) {
-        return end;
-    }
-
-    if (*begin == ',') {
-        begin++;
-    }
-
-    return FwdSpaces(begin, end);
-}
-
-static inline const char *FindChar(const char *begin, const char *end, char c) {
-    while (begin != end && *begin != c) {
-        begin++;
-    }
-
-    return begin;
-}
-
-static inline size_t CountChar(const char *begin, const char *end, char c) {
-    size_t count = 0;
-    while (begin != end) {
-        if (*begin == c)
-            count++;
-
-        begin++;
-    }
-
-    return count;
-}
-
-static inline const char *ConsumeString(const char *begin, const char *end) {
-    auto it = FindChar(begin, end, '\"');
-    if (it == begin || it == end) {
-        return it;
-    }
-
-    while (it != end && *(it - 1) == '\\') {
-        it = FindChar(it + 1, end, '\"');
-    }
-
-    return it;
-}
+using namespace Tokenizer;
 
 static bool ParseToken(Element *elem, const char *begin, const char *end,
                        const char **term, StringView token) {
@@ -200,38 +43,10 @@ static bool ParseString(Element *elem, const char *begin, const char *end,
 }
 
 static bool ParseNumber(Element *elem, const char *begin, const char *end,
-                        const char **term) {
-    // Skip past first char, as it's confirmed to be valid, and might be a '-'
-    auto numEnd = begin + 1;
-    int dotCount = 0;
-    int numCount = 0;
-    bool malformed = true;
-
-    // A number can only start with a dash or a digit, if we got here and it's
-    // not a dash, it's safe to assume it's a digit
-    if (*begin != '-') {
-        malformed = false;
-        numCount++;
-    }
-
-    while (numEnd != end && isDigitOrDot(*numEnd)) {
-        if (*numEnd == '.') {
-            // Dot
-            malformed = true; // A number is not allowed to end with a dot
-            if (numCount == 0 || ++dotCount > 1) {
-                // A dot must be preceded by a number, and there can only be one
-                // dot in a number
-                break;
-            }
-        } else {
-            // Digit
-            numCount++;
-            malformed = false;
-        }
-        numEnd++;
-    }
-
-    if (malformed) {
+                        const char **term, bool decode = false) {
+    NumberScan scan;
+    auto numEnd = ScanNumber(begin, end, decode ? &scan : nullptr);
+    if (!numEnd) {
         elem->ref = "Malformed number";
         return false;
     }
@@ -239,6 +54,15 @@ static bool ParseNumber(Element *elem, const char *begin, const char *end,
     elem->type = Element::Type::Number;
     elem->ref = {begin, numEnd};
 
+    if (decode) {
+        if (scan.isInteger) {
+            elem->intValue = scan.integer;
+            elem->decoded = Element::Decoded::Integer;
+        } else {
+            elem->DecodeNumber();
+        }
+    }
+
     if (term) {
         *term = numEnd;
     }
@@ -246,84 +70,79 @@ static bool ParseNumber(Element *elem, const char *begin, const char *end,
     return true;
 }
 
-void Element::EscapeStr(ArenaAllocator &arena) {
-    auto count = CountChar(ref.begin, ref.end, '\\');
+bool Element::DecodeNumber() {
+    if (type != Type::Number) {
+        return false;
+    }
 
-    size_t totalSize = cleanRef.Size() + count;
-    char *target = arena.AllocateString(totalSize);
-    char *t = target;
-    bool isDirty = false;
-
-    for (auto c = ref.begin; c != ref.end;) {
-        // if (*c >= 0x80) {
-        //     // Unicode
-        //     size_t u = 0;
-
-        //     *(t++) = '\\';
-        //     *(t++) = 'u';
-        //     *(t++) = GetHexChar((u >> 12) & 0xf);
-        //     *(t++) = GetHexChar((u >> 8) & 0xf);
-        //     *(t++) = GetHexChar((u >> 4) & 0xf);
-        //     *(t++) = GetHexChar(u & 0xf);
-
-        //     continue;
-        // }
-
-        switch (*c) {
-        case '\b':
-            *(t++) = '\\';
-            *(t++) = 'b';
-            c++;
-            isDirty = true;
-            break;
-        case '\f':
-            *(t++) = '\\';
-            *(t++) = 'f';
-            c++;
-            isDirty = true;
-            break;
-        case '\n':
-            *(t++) = '\\';
-            *(t++) = 'n';
-            c++;
-            isDirty = true;
-            break;
-        case '\r':
-            *(t++) = '\\';
-            *(t++) = 'r';
-            c++;
-            isDirty = true;
-            break;
-        case '\t':
-            *(t++) = '\\';
-            *(t++) = 't';
-            c++;
-            isDirty = true;
-            break;
-        case '\"':
-            *(t++) = '\\';
-            *(t++) = '\"';
-            c++;
-            isDirty = true;
-            break;
-        case '\\':
-            *(t++) = '\\';
-            *(t++) = '\\';
-            c++;
-            isDirty = true;
-            break;
-        default:
-            *(t++) = *(c++);
+    if (decoded != Decoded::None) {
+        return true;
+    }
+
+    // Negative zero is left to the double, as an integer it would lose its
+    // sign
+    int64_t i;
+    auto res = std::from_chars(ref.begin, ref.end, i);
+    if (res.ec == std::errc() && res.ptr == ref.end &&
+        (i != 0 || *ref.begin != '-')) {
+        intValue = i;
+        decoded = Decoded::Integer;
+        return true;
+    }
+
+    double d;
+    auto fres = fast_float::from_chars(ref.begin, ref.end, d);
+    if (fres.ec == std::errc() && fres.ptr == ref.end) {
+        floatValue = d;
+        decoded = Decoded::FloatingPoint;
+        return true;
+    }
+
+    return false;
+}
+
+bool Element::Freeze(ArenaAllocator &arena) {
+    switch (type) {
+    case Type::String:
+    case Type::Key:
+        if (!GetString(arena).begin || !GetEscapedString(arena).begin) {
+            return false;
         }
+        return type == Type::String || !firstChild ||
+               firstChild->Freeze(arena);
+
+    case Type::Number:
+        DecodeNumber(); // Numbers that don't decode are read from the text
+        return true;
+
+    case Type::Object:
+    case Type::Array:
+        for (auto it = firstChild; it != nullptr; it = it->next) {
+            if (!it->Freeze(arena)) {
+                return false;
+            }
+        }
+        return true;
+
+    default:
+        return type != Type::Error;
     }
+}
 
-    if (!isDirty) {
-        ref = cleanRef;
-        arena.ReturnUnused(totalSize);
-    } else {
-        ref = {target, t};
-        arena.ReturnUnused(totalSize - std::distance(target, t));
+void Element::EscapeStr(ArenaAllocator &arena) {
+    size_t totalSize = EscapedSize(cleanRef.begin, cleanRef.end);
+    if (totalSize == cleanRef.Size()) {
+        ref = cleanRef; // Nothing to escape, share the storage
+        return;
+    }
+
+    char *target = arena.AllocateString(totalSize);
+    if (!target) {
+        ref = {};
+        return;
     }
+
+    ref = {target, EscapeChars(cleanRef.begin, cleanRef.end, target)};
 }
 
 static int ReadUnicodeLiteral(const char *begin, const char *end,
@@ -340,7 +159,7 @@ static int ReadUnicodeLiteral(const char *begin, const char *end,
 
         int8_t val = GetHexValue(*(begin++));
         if (val == -1)
-            return false;
+            return -1;
 
         u <<= 4;
         u |= val;
@@ -352,20 +171,23 @@ static int ReadUnicodeLiteral(const char *begin, const char *end,
     return u;
 }
 
-bool Element::UnescapeStr(ArenaAllocator &arena) {
-    auto count = CountChar(ref.begin, ref.end, '\\');
+bool UnescapeString(StringView raw, StringView &clean,
+                    ArenaAllocator &arena) {
+    auto count = CountChar(raw.begin, raw.end, '\\');
     if (count == 0) {
-        cleanRef = ref; // This is a clean string, it can be used as is
+        clean = raw; // This is a clean string, it can be used as is
         return true;
     }
 
-    size_t totalSize = ref.Size();
+    STUPID_JSON_TRACE_HOOK(Unescape, raw.begin, raw.end);
+
+    size_t totalSize = raw.Size();
     char *target = arena.AllocateString(totalSize);
     char *t = target;
 
-    for (auto c = ref.begin; c != ref.end;) {
+    for (auto c = raw.begin; c != raw.end;) {
         if (*c == '\\') {
-            if (c + 1 == ref.end) {
+            if (c + 1 == raw.end) {
                 return false;
             }
 
@@ -398,8 +220,12 @@ bool Element::UnescapeStr(ArenaAllocator &arena) {
                 *(t++) = '\\';
                 c += 2;
                 break;
+            case '/':
+                *(t++) = '/';
+                c += 2;
+                break;
             case 'u': {
-                int lit = ReadUnicodeLiteral(c, ref.end, &c);
+                int lit = ReadUnicodeLiteral(c, raw.end, &c);
                 if (lit == -1) {
                     return false;
                 }
@@ -407,7 +233,7 @@ bool Element::UnescapeStr(ArenaAllocator &arena) {
                 uint32_t u = lit;
 
                 if (0xD800 <= lit && lit <= 0xDBFF) {
-                    lit = ReadUnicodeLiteral(c, ref.end, &c);
+                    lit = ReadUnicodeLiteral(c, raw.end, &c);
                     if (0xDC00 > lit || lit > 0xDFFF) {
                         return false;
                     }
@@ -448,22 +274,105 @@ bool Element::UnescapeStr(ArenaAllocator &arena) {
         }
     }
 
-    arena.ReturnUnused(totalSize - std::distance(target, t));
-    cleanRef = {target, t};
-    // std::cout << "Unclean str: " << cleanRef.ToStd() << std::endl;
+    arena.ReturnUnused(target + totalSize,
+                       totalSize - std::distance(target, t));
+    clean = {target, t};
+    // std::cout << "Unclean str: " << clean.ToStd() << std::endl;
+    return true;
+}
+
+bool KeyEquals(StringView raw, StringView name, ArenaAllocator &arena) {
+    if (FindChar(raw.begin, raw.end, '\\') == raw.end) {
+        return raw == name;
+    }
+
+    // The key contains escapes, an unescaped key is never longer than the raw
+    // one, so this can be rejected early
+    if (raw.Size() < name.Size()) {
+        return false;
+    }
+
+    StringView clean;
+    return UnescapeString(raw, clean, arena) && clean == name;
+}
+
+bool Element::UnescapeStr(ArenaAllocator &arena) {
+    return UnescapeString(ref, cleanRef, arena);
+}
+
+// A projection node of nullptr keeps everything
+using ProjectionNode = Projection::Node;
+
+// A shape node of nullptr parses keys without speculating
+using ShapeNode = Shape::Node;
+
+// State shared by every level of a single ParseBody call
+struct ParseContext {
+    ArenaAllocator &arena;
+    const ParseOptions &options;
+};
+
+static bool ParseValue(Element *elem, const char *begin, const char *end,
+                       ParseContext &ctx, const char **term,
+                       const ProjectionNode *proj, ShapeNode *shape);
+
+// Skip over the value of a member that is not projected
+static bool SkipMember(Element *elem, const char *begin, const char *end,
+                       const char **term) {
+    begin = FwdSpaces(begin, end);
+    if (begin == end || *begin != ':') {
+        elem->type = Element::Type::Error;
+        elem->ref = "Invalid char after key";
+        return false;
+    }
+
+    begin = SkipValue(FwdSpaces(begin + 1, end), end);
+    if (!begin) {
+        elem->type = Element::Type::Error;
+        elem->ref = "End of stream reached before end of object";
+        return false;
+    }
+
+    *term = begin;
     return true;
 }
 
 static bool ParseObject(Element *elem, const char *begin, const char *end,
-                        ArenaAllocator &arena, const char **term) {
+                        ParseContext &ctx, const char **term,
+                        const ProjectionNode *proj, ShapeNode *shape) {
     elem->type = Element::Type::Object; // Set type at the start, so that
                                         // the helper works
+    const char *open = begin - 1;
     begin = FwdSpaces(begin, end);
 
+    if (proj) {
+        shape = nullptr;
+    }
+
+    // Keys are checked against the shape until the first one that differs,
+    // the first key picks which of the learned orders to check
+    size_t index = 0;
+    bool stable = shape != nullptr;
+    Shape::Keys *keys = nullptr;
+
     while (begin != end) {
         if (*begin == '}') {
+            elem->ref = {open, begin + 1}; // The source, brackets included
             if (term)
                 *term = begin + 1;
+
+            // Empty objects have nothing to check. Records that leave out
+            // the last keys of an order still matched every key they have.
+            if (shape && index != 0) {
+                if (stable) {
+                    shape->hits++;
+                } else {
+                    if (shape->Learning()) {
+                        shape->Learn(elem);
+                    }
+                    shape->misses++;
+                }
+            }
             return true;
         }
 
@@ -473,15 +382,59 @@ static bool ParseObject(Element *elem, const char *begin, const char *end,
             return false;
         }
 
-        auto strEnd = ConsumeString(begin + 1, end);
+        Shape::Key *expected = nullptr;
+        if (stable && index == 0) {
+            keys = shape->Select(begin, end);
+            expected = keys ? &keys->front() : nullptr;
+            stable = expected != nullptr;
+        } else if (stable) {
+            if (index < keys->size()) {
+                auto &raw = (*keys)[index].raw;
+                if (static_cast<size_t>(end - begin) >= raw.size() &&
+                    memcmp(begin, raw.data(), raw.size()) == 0) {
+                    expected = &(*keys)[index];
+                }
+            }
+
+            // Variants of a record share their first keys
+            if (!expected) {
+                keys = shape->Switch(keys, index, begin, end);
+                expected = keys ? &(*keys)[index] : nullptr;
+            }
+
+            stable = expected != nullptr;
+        }
+
+        // The closing quote is part of the expected key, so a match ends
+        // exactly where scanning the string would
+        auto strEnd = expected ? begin + expected->raw.size() - 1
+                               : ConsumeString(begin + 1, end);
         if (strEnd == end) {
             elem->ref = "Key not terminated before end of stream";
             return false;
         }
 
         begin++; // Skip over opening quote
-        Element *key = arena.CreateElement();
-        Element *value = arena.CreateElement();
+
+        const ProjectionNode *sub = nullptr;
+        if (proj) {
+            sub = Projection::Match(proj, {begin, strEnd}, ctx.arena);
+            if (!sub) {
+                if (!SkipMember(elem, strEnd + 1, end, &begin)) {
+                    return false;
+                }
+
+                begin = FwdCommaOrTerm(begin, end, '}');
+                continue;
+            }
+
+            if (sub->keepAll) {
+                sub = nullptr;
+            }
+        }
+
+        Element *key = ctx.arena.CreateElement();
+        Element *value = ctx.arena.CreateElement();
 
         if (!key || !value) {
             elem->ref = "Failed to allocate element";
@@ -490,7 +443,9 @@ static bool ParseObject(Element *elem, const char *begin, const char *end,
 
         key->type = Element::Type::Key;
         key->ref = {begin, strEnd};
-        if (!key->UnescapeStr(arena)) {
+        if (expected && !expected->escaped) {
+            key->cleanRef = key->ref; // Known to have nothing to unescape
+        } else if (!key->UnescapeStr(ctx.arena)) {
             elem->type = Element::Type::Error;
             elem->ref = "Key contains incorrectly escaped characters";
             return false;
@@ -507,7 +462,12 @@ static bool ParseObject(Element *elem, const char *begin, const char *end,
         }
 
         begin++; // Skip over colon
-        if (value->ParseBody({begin, end}, arena, &begin)) {
+
+        // Learning gives the keys of containers a node, scalars have no keys
+        ShapeNode *childShape = expected ? expected->child.get() : nullptr;
+        index++;
+
+        if (ParseValue(value, begin, end, ctx, &begin, sub, childShape)) {
             if (!elem->ObjectPush(key, value)) {
                 elem->type = Element::Type::Error;
                 elem->ref = "Failed to append key to object";
@@ -527,14 +487,17 @@ static bool ParseObject(Element *elem, const char *begin, const char *end,
 }
 
 static bool ParseArray(Element *elem, const char *begin, const char *end,
-                       ArenaAllocator &arena, const char **term) {
+                       ParseContext &ctx, const char **term,
+                       const ProjectionNode *proj, ShapeNode *shape) {
     elem->type = Element::Type::Array; // Set type at the start, so that the
                                        // helper works
+    const char *open = begin - 1;
     begin = FwdSpaces(begin, end);
 
     while (begin != end) {
         if (*begin == ']') {
             begin++;
+            elem->ref = {open, begin}; // The source, brackets included
 
             if (term) {
                 *term = begin;
@@ -543,14 +506,27 @@ static bool ParseArray(Element *elem, const char *begin, const char *end,
             return true;
         }
 
-        Element *el = arena.CreateElement();
+        Element *el = ctx.arena.CreateElement();
         if (!el) {
             elem->type = Element::Type::Error;
             elem->ref = "Failed to allocate element";
             return false;
         }
 
-        if (el->ParseBody({begin, end}, arena, &begin)) {
+        // Numbers are decoded during the scan, while the text is in cache
+        bool parsed;
+        if (ctx.options.decodeNumbers && (isDigit(*begin) || *begin == '-')) {
+            el->type = Element::Type::Error;
+            el->next = nullptr;
+            el->firstChild = nullptr;
+            el->lastChild = nullptr;
+            el->childCount = 0;
+            parsed = ParseNumber(el, begin, end, &begin, true);
+        } else {
+            parsed = ParseValue(el, begin, end, ctx, &begin, proj, shape);
+        }
+
+        if (parsed) {
             elem->ArrayPush(el);
         } else {
             elem->type = Element::Type::Error;
@@ -568,55 +544,60 @@ static bool ParseArray(Element *elem, const char *begin, const char *end,
     return false;
 }
 
-bool Element::ParseBody(StringView body, ArenaAllocator &arena,
-                        const char **term) {
-    auto begin = body.begin, end = body.end;
-
+static bool ParseValue(Element *elem, const char *begin, const char *end,
+                       ParseContext &ctx, const char **term,
+                       const ProjectionNode *proj, ShapeNode *shape) {
     // Reset element, in case it is being reused
-    type = Type::Error;
-    next = nullptr;
-    firstChild = nullptr;
-    lastChild = nullptr;
-    childCount = 0;
+    elem->type = Element::Type::Error;
+    elem->next = nullptr;
+    elem->firstChild = nullptr;
+    elem->lastChild = nullptr;
+    elem->childCount = 0;
 
     begin = FwdSpaces(begin, end);
     if (begin == end) {
-        ref = "Element not found before end of document";
+        elem->ref = "Element not found before end of document";
         return false;
     }
 
     switch (*begin) {
     case '\"':
-        ParseString(this, begin + 1, end, term);
-        if (!UnescapeStr(arena)) {
-            type = Type::Error;
-            ref = "String contains incorrectly escaped characters";
+        ParseString(elem, begin + 1, end, term);
+        if (!elem->UnescapeStr(ctx.arena)) {
+            elem->type = Element::Type::Error;
+            elem->ref = "String contains incorrectly escaped characters";
         }
         break;
 
     case '{':
-        ParseObject(this, begin + 1, end, arena, term);
+        STUPID_JSON_TRACE_HOOK(ContainerEnter, elem, begin);
+        ParseObject(elem, begin + 1, end, ctx, term, proj, shape);
+        STUPID_JSON_TRACE_HOOK(ContainerExit, elem,
+                               elem->type != Element::Type::Error);
         break;
 
     case '[':
-        ParseArray(this, begin + 1, end, arena, term);
+        STUPID_JSON_TRACE_HOOK(ContainerEnter, elem, begin);
+        ParseArray(elem, begin + 1, end, ctx, term, proj, shape);
+        STUPID_JSON_TRACE_HOOK(ContainerExit, elem,
+                               elem->type != Element::Type::Error);
         break;
 
     case 'n':
-        if (ParseToken(this, begin, end, term, "null")) {
-            type = Type::Null;
+        if (ParseToken(elem, begin, end, term, "null")) {
+            elem->type = Element::Type::Null;
         }
         break;
 
     case 't':
-        if (ParseToken(this, begin, end, term, "true")) {
-            type = Type::True;
+        if (ParseToken(elem, begin, end, term, "true")) {
+            elem->type = Element::Type::True;
         }
         break;
 
     case 'f':
-        if (ParseToken(this, begin, end, term, "false")) {
-            type = Type::False;
+        if (ParseToken(elem, begin, end, term, "false")) {
+            elem->type = Element::Type::False;
         }
         break;
 
@@ -631,15 +612,38 @@ bool Element::ParseBody(StringView body, ArenaAllocator &arena,
     case '8':
     case '9':
     case '-':
-        ParseNumber(this, begin, end, term);
+        ParseNumber(elem, begin, end, term);
         break;
 
     default:
-        ref = "Reached end of parsing";
+        elem->ref = "Reached end of parsing";
         break;
     }
 
-    return type != Type::Error;
+    return elem->type != Element::Type::Error;
+}
+
+bool Element::ParseBody(StringView body, ArenaAllocator &arena,
+                        const char **term) {
+    return ParseBody(body, arena, ParseOptions{}, term);
+}
+
+bool Element::ParseBody(StringView body, ArenaAllocator &arena,
+                        const ParseOptions &options, const char **term) {
+    const ProjectionNode *proj = nullptr;
+    if (options.projection) {
+        proj = options.projection->Root();
+    }
+
+    ParseContext ctx{arena, options};
+
+    STUPID_JSON_TRACE_HOOK(ParseBegin, this, body.begin, body.end);
+    ShapeNode *shape = options.shape ? options.shape->Root() : nullptr;
+
+    bool res = ParseValue(this, body.begin, body.end, ctx, term, proj, shape);
+    STUPID_JSON_TRACE_HOOK(ParseEnd, this, res);
+
+    return res;
 }
 
 bool Element::Serialize(ArenaAllocator &arena, std::ostream &s, int level) {
@@ -760,6 +764,9 @@ ArenaAllocator::AllocateStrings(size_t size) {
     alloc->next = nextStringAlloc;
     nextStringAlloc = alloc;
 
+    STUPID_JSON_TRACE_HOOK(BlockAllocated, this,
+                           size + sizeof(StringAllocHeader));
+
     return alloc;
 }
 
@@ -775,12 +782,61 @@ void ArenaAllocator::AllocateElements() {
     alloc->next = nextElementAlloc;
     nextElementAlloc = alloc;
 
+    STUPID_JSON_TRACE_HOOK(BlockAllocated, this,
+                           elementAllocSize * sizeof(Element));
+
     // printf("Alloc grow: %lu\n", elementAllocSize);
     if (elementAllocSize < (1 << 16)) {
         elementAllocSize <<= 1;
     }
 };
 
+Element *ArenaAllocator::CreateElements(size_t count) {
+    if (count == 0) {
+        return nullptr;
+    }
+
+    // The first slot of a block holds the header, so a fresh block fits one
+    // element less than its size
+    if ((!nextElementAlloc ||
+         nextElementAlloc->size - nextElementAlloc->head < count) &&
+        count < elementAllocSize) {
+        AllocateElements();
+    }
+
+    if (nextElementAlloc &&
+        nextElementAlloc->size - nextElementAlloc->head >= count) {
+        auto elems = reinterpret_cast<Element *>(nextElementAlloc);
+        Element *first = &elems[nextElementAlloc->head];
+        nextElementAlloc->head += count;
+        return first;
+    }
+
+    // Too large for a regular block, so it gets a block of its own. The block
+    // is full from the start, so it goes behind the current block where it
+    // won't hide the free space left there.
+    auto alloc = reinterpret_cast<ElementAllocHeader *>(
+        calloc(count + 1, sizeof(Element)));
+    if (!alloc) {
+        return nullptr;
+    }
+
+    alloc->head = count + 1;
+    alloc->size = count + 1;
+
+    if (nextElementAlloc) {
+        alloc->next = nextElementAlloc->next;
+        nextElementAlloc->next = alloc;
+    } else {
+        alloc->next = nullptr;
+        nextElementAlloc = alloc;
+    }
+
+    STUPID_JSON_TRACE_HOOK(BlockAllocated, this, (count + 1) * sizeof(Element));
+
+    return reinterpret_cast<Element *>(alloc) + 1;
+}
+
 char *ArenaAllocator::AllocateString(size_t size) {
     StringAllocHeader *it = nextStringAlloc;
     int searchLength = 3; // Max steps-1 to search for free space
@@ -815,12 +871,74 @@ char *ArenaAllocator::AllocateString(size_t size) {
     return ptr;
 }
 
-void ArenaAllocator::ReturnUnused(size_t size) {
-    if (!nextStringAlloc)
-        return;
-    if (nextStringAlloc->head < size)
-        return;
-    nextStringAlloc->head -= size;
+void *ArenaAllocator::Allocate(size_t size, size_t align) {
+    assert(align != 0 && (align & (align - 1)) == 0);
+
+    // Bytes to skip so that the write head of a block is aligned
+    auto padding = [align](StringAllocHeader *alloc) {
+        auto head = reinterpret_cast<uintptr_t>(alloc + 1) + alloc->head;
+        return static_cast<size_t>(-head & (align - 1));
+    };
+
+    StringAllocHeader *it = nextStringAlloc;
+    int searchLength = 3;
+
+    while (it) {
+        if (it->Remain() >= size + padding(it)) {
+            break;
+        }
+
+        if (searchLength-- == 0) {
+            it = nullptr;
+            break;
+        }
+
+        it = it->next;
+    }
+
+    // Containers are built one after another, so they get larger blocks than
+    // strings do to avoid a malloc for each of them
+    if (!it) {
+        it = AllocateStrings(std::max<size_t>(size + align - 1, 16 * 1024));
+        if (!it) {
+            return nullptr;
+        }
+    }
+
+    it->head += padding(it);
+    char *ptr = reinterpret_cast<char *>(it + 1) + it->head;
+    it->head += size;
+
+    return ptr;
+}
+
+void ArenaAllocator::ReturnUnused(const char *end, size_t size) {
+    // The allocation may be in any of the blocks AllocateString searches, and
+    // only the block whose write head it ends at can take the bytes back
+    StringAllocHeader *it = nextStringAlloc;
+    for (int i = 0; it && i < 4; ++i, it = it->next) {
+        auto head = reinterpret_cast<const char *>(it + 1) + it->head;
+        if (head == end) {
+            if (it->head >= size) {
+                it->head -= size;
+            }
+            return;
+        }
+    }
+}
+
+size_t ArenaAllocator::Footprint() const {
+    size_t bytes = 0;
+
+    for (auto it = nextElementAlloc; it != nullptr; it = it->next) {
+        bytes += it->size * sizeof(Element);
+    }
+
+    for (auto it = nextStringAlloc; it != nullptr; it = it->next) {
+        bytes += it->size + sizeof(StringAllocHeader);
+    }
+
+    return bytes;
 }
 
 StringView ArenaAllocator::PushString(StringView view) {
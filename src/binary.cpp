@@ -0,0 +1,1061 @@
+#include "stupid-json/binary.hpp"
+
+namespace StupidJSON {
+
+namespace {
+
+enum class ItemType {
+    Null,
+    True,
+    False,
+    Integer,
+    Unsigned, // Above the range of int64_t
+    Double,
+    Float,
+    String,
+    Array,
+    Map,
+    Break, // End of a CBOR container of indefinite length
+};
+
+// The header of one value, containers are followed by their items
+struct Item {
+    ItemType type;
+    union {
+        int64_t intValue;
+        uint64_t uintValue;
+        double doubleValue;
+        float floatValue;
+    };
+    StringView str;
+    size_t count;    // Items in an array or pairs in a map
+    bool indefinite; // Ends with a break instead of after count
+};
+
+struct Input {
+    const unsigned char *it;
+    const unsigned char *end;
+    const char *error = nullptr;
+
+    // Strings that come in chunks are joined in the arena, or in the scratch
+    // buffer without one, where they stay until the next item is read
+    ArenaAllocator *arena = nullptr;
+    std::string *scratch = nullptr;
+
+    explicit Input(StringView body)
+        : it(reinterpret_cast<const unsigned char *>(body.begin)),
+          end(reinterpret_cast<const unsigned char *>(body.end)) {}
+
+    bool Fail(const char *msg) {
+        if (!error) {
+            error = msg;
+        }
+        return false;
+    }
+
+    // Big endian, as both formats are
+    bool ReadUint(size_t n, uint64_t &val) {
+        if (static_cast<size_t>(end - it) < n) {
+            return Fail("End of input reached before end of value");
+        }
+
+        val = 0;
+        for (size_t i = 0; i < n; ++i) {
+            val = (val << 8) | *it++;
+        }
+        return true;
+    }
+
+    bool ReadBytes(uint64_t n, StringView &str) {
+        if (static_cast<uint64_t>(end - it) < n) {
+            return Fail("End of input reached before end of string");
+        }
+
+        str = {reinterpret_cast<const char *>(it), static_cast<size_t>(n)};
+        it += n;
+        return true;
+    }
+
+    static void SetInteger(Item &item, uint64_t val) {
+        if (val > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) {
+            item.type = ItemType::Unsigned;
+            item.uintValue = val;
+        } else {
+            item.type = ItemType::Integer;
+            item.intValue = static_cast<int64_t>(val);
+        }
+    }
+};
+
+struct MessagePackInput : Input {
+    using Input::Input;
+
+    bool Next(Item &item) {
+        if (it == end) {
+            return Fail("End of input reached before end of value");
+        }
+
+        uint8_t b = *it++;
+        item.indefinite = false;
+
+        if (b <= 0x7f) {
+            item.type = ItemType::Integer;
+            item.intValue = b;
+            return true;
+        }
+
+        if (b >= 0xe0) {
+            item.type = ItemType::Integer;
+            item.intValue = static_cast<int8_t>(b);
+            return true;
+        }
+
+        if (b <= 0x8f) {
+            item.type = ItemType::Map;
+            item.count = b & 0x0f;
+            return true;
+        }
+
+        if (b <= 0x9f) {
+            item.type = ItemType::Array;
+            item.count = b & 0x0f;
+            return true;
+        }
+
+        if (b <= 0xbf) {
+            item.type = ItemType::String;
+            return ReadBytes(b & 0x1f, item.str);
+        }
+
+        uint64_t val;
+
+        switch (b) {
+        case 0xc0:
+            item.type = ItemType::Null;
+            return true;
+
+        case 0xc2:
+            item.type = ItemType::False;
+            return true;
+
+        case 0xc3:
+            item.type = ItemType::True;
+            return true;
+
+        case 0xc4:
+        case 0xc5:
+        case 0xc6:
+            return Fail("Binary data has no JSON equivalent");
+
+        case 0xc7:
+        case 0xc8:
+        case 0xc9:
+        case 0xd4:
+        case 0xd5:
+        case 0xd6:
+        case 0xd7:
+        case 0xd8:
+            return Fail("Extension types have no JSON equivalent");
+
+        case 0xca: {
+            if (!ReadUint(4, val)) {
+                return false;
+            }
+            uint32_t bits = static_cast<uint32_t>(val);
+            item.type = ItemType::Float;
+            memcpy(&item.floatValue, &bits, sizeof(bits));
+            return true;
+        }
+
+        case 0xcb:
+            if (!ReadUint(8, val)) {
+                return false;
+            }
+            item.type = ItemType::Double;
+            memcpy(&item.doubleValue, &val, sizeof(val));
+            return true;
+
+        case 0xcc:
+        case 0xcd:
+        case 0xce:
+        case 0xcf:
+            if (!ReadUint(size_t(1) << (b - 0xcc), val)) {
+                return false;
+            }
+            SetInteger(item, val);
+            return true;
+
+        case 0xd0:
+        case 0xd1:
+        case 0xd2:
+        case 0xd3: {
+            size_t n = size_t(1) << (b - 0xd0);
+            if (!ReadUint(n, val)) {
+                return false;
+            }
+
+            // Sign extend from the top bit that was read
+            if (n < 8 && (val >> (n * 8 - 1)) != 0) {
+                val |= ~uint64_t(0) << (n * 8);
+            }
+            item.type = ItemType::Integer;
+            item.intValue = static_cast<int64_t>(val);
+            return true;
+        }
+
+        case 0xd9:
+        case 0xda:
+        case 0xdb:
+            if (!ReadUint(size_t(1) << (b - 0xd9), val)) {
+                return false;
+            }
+            item.type = ItemType::String;
+            return ReadBytes(val, item.str);
+
+        case 0xdc:
+        case 0xdd:
+        case 0xde:
+        case 0xdf:
+            if (!ReadUint(b & 1 ? 4 : 2, val)) {
+                return false;
+            }
+            item.type = b < 0xde ? ItemType::Array : ItemType::Map;
+            item.count = static_cast<size_t>(val);
+            return true;
+
+        default:
+            return Fail("Invalid type byte");
+        }
+    }
+};
+
+static float HalfToFloat(uint16_t half) {
+    int exp = (half >> 10) & 0x1f;
+    int mant = half & 0x3ff;
+
+    float val;
+    if (exp == 0) {
+        val = std::ldexp(static_cast<float>(mant), -24);
+    } else if (exp != 31) {
+        val = std::ldexp(static_cast<float>(mant + 1024), exp - 25);
+    } else {
+        val = mant == 0 ? std::numeric_limits<float>::infinity()
+                        : std::numeric_limits<float>::quiet_NaN();
+    }
+
+    return half & 0x8000 ? -val : val;
+}
+
+struct CBORInput : Input {
+    using Input::Input;
+
+    // The argument of a head, info is the low five bits of its first byte
+    bool Argument(uint8_t info, uint64_t &val) {
+        if (info < 24) {
+            val = info;
+            return true;
+        }
+
+        if (info > 27) {
+            return Fail("Invalid additional information");
+        }
+
+        return ReadUint(size_t(1) << (info - 24), val);
+    }
+
+    // Walk the chunks of a text string of indefinite length, up to and
+    // including the break, calling f on each
+    template <typename F> bool EachChunk(F f) {
+        while (true) {
+            if (it == end) {
+                return Fail("End of input reached before end of string");
+            }
+
+            uint8_t b = *it++;
+            if (b == 0xff) {
+                return true;
+            }
+
+            uint64_t n;
+            StringView chunk;
+            if ((b >> 5) != 3 || (b & 0x1f) == 31 || !Argument(b & 0x1f, n) ||
+                !ReadBytes(n, chunk)) {
+                return Fail("Invalid chunk in string");
+            }
+
+            f(chunk);
+        }
+    }
+
+    // Measure first, so that the chunks are copied once
+    bool Chunks(StringView &str) {
+        const unsigned char *first = it;
+
+        size_t size = 0;
+        if (!EachChunk([&](StringView chunk) { size += chunk.Size(); })) {
+            return false;
+        }
+
+        if (size == 0) {
+            str = "";
+            return true;
+        }
+
+        char *out;
+        if (arena) {
+            out = arena->AllocateString(size);
+            if (!out) {
+                return Fail("Failed to allocate string");
+            }
+        } else {
+            scratch->resize(size);
+            out = scratch->data();
+        }
+
+        str = {out, size};
+        it = first;
+        return EachChunk([&](StringView chunk) {
+            memcpy(out, chunk.begin, chunk.Size());
+            out += chunk.Size();
+        });
+    }
+
+    bool Next(Item &item) {
+        uint8_t major;
+        uint8_t info;
+
+        // Tags only annotate the value after them, so they are skipped
+        while (true) {
+            if (it == end) {
+                return Fail("End of input reached before end of value");
+            }
+
+            major = *it >> 5;
+            info = *it++ & 0x1f;
+            if (major != 6) {
+                break;
+            }
+
+            uint64_t tag;
+            if (info == 31 || !Argument(info, tag)) {
+                return Fail("Invalid tag");
+            }
+        }
+
+        // Only strings, containers and the break may be indefinite
+        item.indefinite = info == 31;
+        if (item.indefinite && major < 2) {
+            return Fail("Invalid additional information");
+        }
+
+        uint64_t arg = 0;
+        if (!item.indefinite && !Argument(info, arg)) {
+            return false;
+        }
+
+        switch (major) {
+        case 0:
+            SetInteger(item, arg);
+            return true;
+
+        case 1:
+            // The value is -1 - arg, which may not fit
+            if (arg > static_cast<uint64_t>(
+                          std::numeric_limits<int64_t>::max())) {
+                return Fail("Negative integer too large");
+            }
+            item.type = ItemType::Integer;
+            item.intValue = -1 - static_cast<int64_t>(arg);
+            return true;
+
+        case 2:
+            return Fail("Binary data has no JSON equivalent");
+
+        case 3:
+            item.type = ItemType::String;
+            return item.indefinite ? Chunks(item.str)
+                                   : ReadBytes(arg, item.str);
+
+        case 4:
+        case 5:
+            item.type = major == 4 ? ItemType::Array : ItemType::Map;
+            item.count = static_cast<size_t>(arg);
+            return true;
+
+        default:
+            break;
+        }
+
+        switch (info) {
+        case 20:
+            item.type = ItemType::False;
+            return true;
+
+        case 21:
+            item.type = ItemType::True;
+            return true;
+
+        case 22:
+            item.type = ItemType::Null;
+            return true;
+
+        case 25:
+            item.type = ItemType::Float;
+            item.floatValue = HalfToFloat(static_cast<uint16_t>(arg));
+            return true;
+
+        case 26: {
+            uint32_t bits = static_cast<uint32_t>(arg);
+            item.type = ItemType::Float;
+            memcpy(&item.floatValue, &bits, sizeof(bits));
+            return true;
+        }
+
+        case 27:
+            item.type = ItemType::Double;
+            memcpy(&item.doubleValue, &arg, sizeof(arg));
+            return true;
+
+        case 31:
+            item.type = ItemType::Break;
+            return true;
+
+        default:
+            return Fail("Simple value has no JSON equivalent");
+        }
+    }
+};
+
+static void PutBigEndian(std::string &out, uint64_t val, size_t n) {
+    char buf[8];
+    for (size_t i = 0; i < n; ++i) {
+        buf[i] = static_cast<char>(val >> ((n - 1 - i) * 8));
+    }
+    out.append(buf, n);
+}
+
+// Floats that hold a double exactly are written in half the space
+static bool FitsFloat(double val) {
+    return static_cast<double>(static_cast<float>(val)) == val;
+}
+
+struct MessagePackOutput {
+    std::string &out;
+
+    void Null() { out += '\xc0'; }
+    void Bool(bool val) { out += val ? '\xc3' : '\xc2'; }
+
+    void Integer(int64_t val) {
+        if (val >= 0) {
+            Unsigned(static_cast<uint64_t>(val));
+        } else if (val >= -32) {
+            out += static_cast<char>(val);
+        } else if (val >= std::numeric_limits<int8_t>::min()) {
+            out += '\xd0';
+            PutBigEndian(out, static_cast<uint64_t>(val), 1);
+        } else if (val >= std::numeric_limits<int16_t>::min()) {
+            out += '\xd1';
+            PutBigEndian(out, static_cast<uint64_t>(val), 2);
+        } else if (val >= std::numeric_limits<int32_t>::min()) {
+            out += '\xd2';
+            PutBigEndian(out, static_cast<uint64_t>(val), 4);
+        } else {
+            out += '\xd3';
+            PutBigEndian(out, static_cast<uint64_t>(val), 8);
+        }
+    }
+
+    void Unsigned(uint64_t val) {
+        if (val <= 0x7f) {
+            out += static_cast<char>(val);
+        } else if (val <= 0xff) {
+            out += '\xcc';
+            PutBigEndian(out, val, 1);
+        } else if (val <= 0xffff) {
+            out += '\xcd';
+            PutBigEndian(out, val, 2);
+        } else if (val <= 0xffffffff) {
+            out += '\xce';
+            PutBigEndian(out, val, 4);
+        } else {
+            out += '\xcf';
+            PutBigEndian(out, val, 8);
+        }
+    }
+
+    void Float(float val) {
+        uint32_t bits;
+        memcpy(&bits, &val, sizeof(bits));
+        out += '\xca';
+        PutBigEndian(out, bits, 4);
+    }
+
+    void Double(double val) {
+        if (FitsFloat(val)) {
+            Float(static_cast<float>(val));
+            return;
+        }
+
+        uint64_t bits;
+        memcpy(&bits, &val, sizeof(bits));
+        out += '\xcb';
+        PutBigEndian(out, bits, 8);
+    }
+
+    bool String(StringView str) {
+        size_t size = str.Size();
+        if (size < 32) {
+            out += static_cast<char>(0xa0 | size);
+        } else if (size <= 0xff) {
+            out += '\xd9';
+            PutBigEndian(out, size, 1);
+        } else if (size <= 0xffff) {
+            out += '\xda';
+            PutBigEndian(out, size, 2);
+        } else if (size <= 0xffffffff) {
+            out += '\xdb';
+            PutBigEndian(out, size, 4);
+        } else {
+            return false;
+        }
+
+        out.append(str.begin, size);
+        return true;
+    }
+
+    bool Container(size_t count, char fix, char head16) {
+        if (count < 16) {
+            out += static_cast<char>(fix | count);
+        } else if (count <= 0xffff) {
+            out += head16;
+            PutBigEndian(out, count, 2);
+        } else if (count <= 0xffffffff) {
+            out += static_cast<char>(head16 + 1);
+            PutBigEndian(out, count, 4);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    bool Array(size_t count) { return Container(count, '\x90', '\xdc'); }
+    bool Map(size_t count) { return Container(count, '\x80', '\xde'); }
+};
+
+struct CBOROutput {
+    std::string &out;
+
+    // Heads always use the shortest argument, as in preferred serialization
+    void Head(uint8_t major, uint64_t arg) {
+        char type = static_cast<char>(major << 5);
+        if (arg < 24) {
+            out += static_cast<char>(type | arg);
+        } else if (arg <= 0xff) {
+            out += static_cast<char>(type | 24);
+            PutBigEndian(out, arg, 1);
+        } else if (arg <= 0xffff) {
+            out += static_cast<char>(type | 25);
+            PutBigEndian(out, arg, 2);
+        } else if (arg <= 0xffffffff) {
+            out += static_cast<char>(type | 26);
+            PutBigEndian(out, arg, 4);
+        } else {
+            out += static_cast<char>(type | 27);
+            PutBigEndian(out, arg, 8);
+        }
+    }
+
+    void Null() { out += '\xf6'; }
+    void Bool(bool val) { out += val ? '\xf5' : '\xf4'; }
+
+    void Integer(int64_t val) {
+        if (val >= 0) {
+            Head(0, static_cast<uint64_t>(val));
+        } else {
+            Head(1, ~static_cast<uint64_t>(val)); // Encodes -1 - val
+        }
+    }
+
+    void Unsigned(uint64_t val) { Head(0, val); }
+
+    void Float(float val) {
+        uint32_t bits;
+        memcpy(&bits, &val, sizeof(bits));
+        out += '\xfa';
+        PutBigEndian(out, bits, 4);
+    }
+
+    void Double(double val) {
+        if (FitsFloat(val)) {
+            Float(static_cast<float>(val));
+            return;
+        }
+
+        uint64_t bits;
+        memcpy(&bits, &val, sizeof(bits));
+        out += '\xfb';
+        PutBigEndian(out, bits, 8);
+    }
+
+    bool String(StringView str) {
+        Head(3, str.Size());
+        out.append(str.begin, str.Size());
+        return true;
+    }
+
+    bool Array(size_t count) {
+        Head(4, count);
+        return true;
+    }
+
+    bool Map(size_t count) {
+        Head(5, count);
+        return true;
+    }
+};
+
+} // namespace
+
+template <typename Out>
+static bool WriteNumber(Element *elem, Out &out) {
+    if (!elem->DecodeNumber()) {
+        return false;
+    }
+
+    if (elem->decoded == Element::Decoded::Integer) {
+        out.Integer(elem->intValue);
+        return true;
+    }
+
+    // Integers past the range of int64_t decode as doubles, but may still
+    // fit as unsigned
+    bool integral = std::none_of(elem->ref.begin, elem->ref.end, [](char c) {
+        return c == '.' || c == 'e' || c == 'E';
+    });
+
+    uint64_t val;
+    if (integral && elem->floatValue >= 9223372036854775808.0) {
+        auto res = std::from_chars(elem->ref.begin, elem->ref.end, val);
+        if (res.ec == std::errc() && res.ptr == elem->ref.end) {
+            out.Unsigned(val);
+            return true;
+        }
+    }
+
+    out.Double(elem->floatValue);
+    return true;
+}
+
+template <typename Out>
+static bool WriteElement(Element *elem, ArenaAllocator &arena, Out &out) {
+    switch (elem->type) {
+    case Element::Type::String: {
+        auto str = elem->GetString(arena);
+        return str.begin != nullptr && out.String(str);
+    }
+
+    case Element::Type::Number:
+        return WriteNumber(elem, out);
+
+    case Element::Type::Object:
+        if (!out.Map(elem->childCount)) {
+            return false;
+        }
+
+        for (auto it = elem->firstChild; it != nullptr; it = it->next) {
+            auto name = it->GetString(arena);
+            if (name.begin == nullptr || !it->firstChild ||
+                !out.String(name) ||
+                !WriteElement(it->firstChild, arena, out)) {
+                return false;
+            }
+        }
+        return true;
+
+    case Element::Type::Array:
+        if (!out.Array(elem->childCount)) {
+            return false;
+        }
+
+        for (auto it = elem->firstChild; it != nullptr; it = it->next) {
+            if (!WriteElement(it, arena, out)) {
+                return false;
+            }
+        }
+        return true;
+
+    case Element::Type::Null:
+        out.Null();
+        return true;
+
+    case Element::Type::True:
+    case Element::Type::False:
+        out.Bool(elem->type == Element::Type::True);
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+bool Element::ToMessagePack(ArenaAllocator &arena, std::string &out) {
+    MessagePackOutput output{out};
+    return WriteElement(this, arena, output);
+}
+
+bool Element::ToCBOR(ArenaAllocator &arena, std::string &out) {
+    CBOROutput output{out};
+    return WriteElement(this, arena, output);
+}
+
+template <typename T>
+static bool SetNumberText(Element *elem, T val, ArenaAllocator &arena) {
+    char buf[64];
+    char *numEnd = FormatNumber(val, buf, buf + sizeof(buf));
+    if (!numEnd) {
+        return false;
+    }
+
+    elem->type = Element::Type::Number;
+    elem->ref = arena.PushString({buf, numEnd});
+    elem->decoded = Element::Decoded::None;
+    return elem->ref.begin != nullptr;
+}
+
+// Shared by the readers and the transcoders, the next item inside a
+// container, or false once a container of count items is done
+template <typename In>
+static bool NextInContainer(In &in, const Item &container, size_t index,
+                            Item &item) {
+    if (!container.indefinite) {
+        return index < container.count && in.Next(item);
+    }
+
+    if (!in.Next(item) || item.type == ItemType::Break) {
+        return false;
+    }
+
+    return true;
+}
+
+template <typename In>
+static bool ReadElement(Element *elem, In &in, ArenaAllocator &arena,
+                        size_t depth);
+
+template <typename In>
+static bool BuildElement(Element *elem, const Item &item, In &in,
+                         ArenaAllocator &arena, size_t depth) {
+    switch (item.type) {
+    case ItemType::Null:
+        elem->type = Element::Type::Null;
+        elem->ref = "null";
+        return true;
+
+    case ItemType::True:
+        elem->type = Element::Type::True;
+        elem->ref = "true";
+        return true;
+
+    case ItemType::False:
+        elem->type = Element::Type::False;
+        elem->ref = "false";
+        return true;
+
+    // The value is known already, so it is stored as decoded
+    case ItemType::Integer:
+        if (!SetNumberText(elem, item.intValue, arena)) {
+            return in.Fail("Failed to set number");
+        }
+        elem->intValue = item.intValue;
+        elem->decoded = Element::Decoded::Integer;
+        return true;
+
+    case ItemType::Unsigned:
+        if (!SetNumberText(elem, item.uintValue, arena)) {
+            return in.Fail("Failed to set number");
+        }
+        return true;
+
+    case ItemType::Double:
+        if (!SetNumberText(elem, item.doubleValue, arena)) {
+            return in.Fail("Number has no JSON equivalent");
+        }
+        elem->floatValue = item.doubleValue;
+        elem->decoded = Element::Decoded::FloatingPoint;
+        return true;
+
+    // The text is the shortest that reads back as the same float, and the
+    // decoded value is the float itself, so it is written back as a float
+    case ItemType::Float:
+        if (!SetNumberText(elem, item.floatValue, arena)) {
+            return in.Fail("Number has no JSON equivalent");
+        }
+        elem->floatValue = item.floatValue;
+        elem->decoded = Element::Decoded::FloatingPoint;
+        return true;
+
+    case ItemType::String:
+        elem->SetString(item.str);
+        return true;
+
+    case ItemType::Array: {
+        if (depth == binaryMaxDepth) {
+            return in.Fail("Containers nested too deep");
+        }
+
+        elem->type = Element::Type::Array;
+
+        Item child;
+        for (size_t i = 0; NextInContainer(in, item, i, child); ++i) {
+            Element *value = arena.CreateElement();
+            if (!value) {
+                return in.Fail("Failed to allocate element");
+            }
+
+            value->next = nullptr;
+            value->firstChild = nullptr;
+            value->lastChild = nullptr;
+            value->childCount = 0;
+            if (!BuildElement(value, child, in, arena, depth + 1)) {
+                return false;
+            }
+
+            elem->ArrayPush(value);
+        }
+        break;
+    }
+
+    case ItemType::Map: {
+        if (depth == binaryMaxDepth) {
+            return in.Fail("Containers nested too deep");
+        }
+
+        elem->type = Element::Type::Object;
+
+        Item name;
+        for (size_t i = 0; NextInContainer(in, item, i, name); ++i) {
+            if (name.type != ItemType::String) {
+                return in.Fail("Object keys must be strings");
+            }
+
+            Element *key = arena.CreateElement();
+            Element *value = arena.CreateElement();
+            if (!key || !value) {
+                return in.Fail("Failed to allocate element");
+            }
+
+            key->next = nullptr;
+            key->firstChild = nullptr;
+            key->Setkey(name.str);
+
+            if (!ReadElement(value, in, arena, depth + 1)) {
+                return false;
+            }
+
+            elem->ObjectPush(key, value);
+        }
+        break;
+    }
+
+    case ItemType::Break:
+        return in.Fail("Break outside of a container");
+    }
+
+    // The loop above ends without an error once the container is complete
+    return in.error == nullptr;
+}
+
+template <typename In>
+static bool ReadElement(Element *elem, In &in, ArenaAllocator &arena,
+                        size_t depth) {
+    elem->next = nullptr;
+    elem->firstChild = nullptr;
+    elem->lastChild = nullptr;
+    elem->childCount = 0;
+
+    Item item;
+    return in.Next(item) && BuildElement(elem, item, in, arena, depth);
+}
+
+template <typename In>
+static bool ParseBinary(Element *root, StringView body, ArenaAllocator &arena,
+                        const char **term) {
+    In in(body);
+    in.arena = &arena;
+
+    if (!ReadElement(root, in, arena, 0)) {
+        root->type = Element::Type::Error;
+        root->ref = in.error;
+        return false;
+    }
+
+    if (term) {
+        *term = reinterpret_cast<const char *>(in.it);
+    }
+
+    return true;
+}
+
+bool Element::ParseMessagePack(StringView body, ArenaAllocator &arena,
+                               const char **term) {
+    return ParseBinary<MessagePackInput>(this, body, arena, term);
+}
+
+bool Element::ParseCBOR(StringView body, ArenaAllocator &arena,
+                        const char **term) {
+    return ParseBinary<CBORInput>(this, body, arena, term);
+}
+
+template <typename In>
+static bool SkipItem(In &in, const Item &item, size_t depth);
+
+// Items left in a container of indefinite length, read from a copy of the
+// input so that the container can be written afterwards
+template <typename In>
+static bool CountItems(In &in, const Item &container, size_t depth,
+                       size_t &count) {
+    In ahead = in;
+
+    Item child;
+    for (count = 0; NextInContainer(ahead, container, count, child);
+         ++count) {
+        if (!SkipItem(ahead, child, depth + 1) ||
+            (container.type == ItemType::Map &&
+             (!ahead.Next(child) || !SkipItem(ahead, child, depth + 1)))) {
+            break;
+        }
+    }
+
+    return ahead.error == nullptr || in.Fail(ahead.error);
+}
+
+template <typename In>
+static bool SkipItem(In &in, const Item &item, size_t depth) {
+    if (item.type == ItemType::Break) {
+        return in.Fail("Break outside of a container");
+    }
+
+    if (item.type != ItemType::Array && item.type != ItemType::Map) {
+        return true;
+    }
+
+    if (depth == binaryMaxDepth) {
+        return in.Fail("Containers nested too deep");
+    }
+
+    Item child;
+    for (size_t i = 0; NextInContainer(in, item, i, child); ++i) {
+        if (!SkipItem(in, child, depth + 1)) {
+            return false;
+        }
+
+        if (item.type == ItemType::Map &&
+            (!in.Next(child) || !SkipItem(in, child, depth + 1))) {
+            return false;
+        }
+    }
+
+    return in.error == nullptr;
+}
+
+template <typename In, typename Out>
+static bool TranscodeItem(In &in, const Item &item, Out &out, size_t depth) {
+    switch (item.type) {
+    case ItemType::Null:
+        out.Null();
+        return true;
+
+    case ItemType::True:
+    case ItemType::False:
+        out.Bool(item.type == ItemType::True);
+        return true;
+
+    case ItemType::Integer:
+        out.Integer(item.intValue);
+        return true;
+
+    case ItemType::Unsigned:
+        out.Unsigned(item.uintValue);
+        return true;
+
+    case ItemType::Double:
+        if (!std::isfinite(item.doubleValue)) {
+            return in.Fail("Number has no JSON equivalent");
+        }
+        out.Double(item.doubleValue);
+        return true;
+
+    case ItemType::Float:
+        if (!std::isfinite(item.floatValue)) {
+            return in.Fail("Number has no JSON equivalent");
+        }
+        out.Float(item.floatValue);
+        return true;
+
+    case ItemType::String:
+        return out.String(item.str) || in.Fail("String too long");
+
+    case ItemType::Array:
+    case ItemType::Map: {
+        if (depth == binaryMaxDepth) {
+            return in.Fail("Containers nested too deep");
+        }
+
+        bool isMap = item.type == ItemType::Map;
+
+        size_t count = item.count;
+        if (item.indefinite && !CountItems(in, item, depth, count)) {
+            return false;
+        }
+
+        if (!(isMap ? out.Map(count) : out.Array(count))) {
+            return in.Fail("Container too large");
+        }
+
+        Item child;
+        for (size_t i = 0; NextInContainer(in, item, i, child); ++i) {
+            if (isMap && child.type != ItemType::String) {
+                return in.Fail("Object keys must be strings");
+            }
+
+            if (!TranscodeItem(in, child, out, depth + 1)) {
+                return false;
+            }
+
+            if (isMap && (!in.Next(child) ||
+                          !TranscodeItem(in, child, out, depth + 1))) {
+                return false;
+            }
+        }
+
+        return in.error == nullptr;
+    }
+
+    case ItemType::Break:
+        return in.Fail("Break outside of a container");
+    }
+
+    return false;
+}
+
+template <typename In, typename Out>
+static bool Transcode(StringView body, std::string &out) {
+    std::string scratch;
+    In in(body);
+    in.scratch = &scratch;
+
+    Out output{out};
+
+    Item item;
+    return in.Next(item) && TranscodeItem(in, item, output, 0);
+}
+
+bool MessagePackToCBOR(StringView body, std::string &out) {
+    return Transcode<MessagePackInput, CBOROutput>(body, out);
+}
+
+bool CBORToMessagePack(StringView body, std::string &out) {
+    return Transcode<CBORInput, MessagePackOutput>(body, out);
+}
+
+} // namespace StupidJSON
@@ -0,0 +1,131 @@
+#include "stupid-json/cache.hpp"
+#include "stupid-json/hash.hpp"
+
+namespace StupidJSON {
+
+ParseCache::ParseCache(size_t budget) : budget(budget) {}
+
+std::shared_ptr<ParseCache::Entry> ParseCache::Find(uint64_t hash,
+                                                    StringView body) {
+    auto range = index.equal_range(hash);
+
+    for (auto it = range.first; it != range.second; ++it) {
+        auto &entry = *it->second;
+
+        // A matching hash is not proof, the text has to match too
+        if (entry->body.Size() != body.Size() ||
+            memcmp(entry->body.begin, body.begin, body.Size()) != 0) {
+            continue;
+        }
+
+        entries.splice(entries.begin(), entries, it->second);
+        return entry;
+    }
+
+    return nullptr;
+}
+
+void ParseCache::Insert(std::shared_ptr<Entry> entry) {
+    // Another thread may have parsed the same body in the meantime
+    if (Find(entry->hash, entry->body)) {
+        return;
+    }
+
+    bytes += entry->bytes;
+    entries.push_front(entry);
+    index.emplace(entry->hash, entries.begin());
+    Evict();
+}
+
+void ParseCache::Evict() {
+    while (bytes > budget && !entries.empty()) {
+        auto &entry = entries.back();
+
+        auto range = index.equal_range(entry->hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second->get() == entry.get()) {
+                index.erase(it);
+                break;
+            }
+        }
+
+        bytes -= entry->bytes;
+        entries.pop_back();
+    }
+}
+
+std::shared_ptr<const Element> ParseCache::Parse(StringView body) {
+    uint64_t hash = Hash64(body);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (auto entry = Find(hash, body)) {
+            hits++;
+            return {entry, entry->root};
+        }
+        misses++;
+    }
+
+    auto entry = std::make_shared<Entry>();
+    entry->hash = hash;
+    entry->body = entry->arena.PushString(body);
+
+    entry->root = entry->arena.CreateElement();
+
+    if (!entry->root->ParseBody(entry->body, entry->arena)) {
+        return {entry, entry->root};
+    }
+
+    // Hits are shared between threads, so nothing may be left to do lazily.
+    // A tree that could not be finished is not safe to share.
+    if (!entry->root->Freeze(entry->arena)) {
+        entry->root->type = Element::Type::Error;
+        entry->root->ref = "Failed to freeze document";
+        return {entry, entry->root};
+    }
+
+    entry->bytes = sizeof(Entry) + entry->arena.Footprint();
+
+    // Documents that could never fit are returned but not kept
+    std::lock_guard<std::mutex> lock(mutex);
+    if (entry->bytes <= budget) {
+        Insert(entry);
+    }
+
+    return {entry, entry->root};
+}
+
+void ParseCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    index.clear();
+    entries.clear();
+    bytes = 0;
+}
+
+void ParseCache::SetBudget(size_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    budget = size;
+    Evict();
+}
+
+size_t ParseCache::Count() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+size_t ParseCache::Bytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return bytes;
+}
+
+size_t ParseCache::Hits() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return hits;
+}
+
+size_t ParseCache::Misses() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return misses;
+}
+
+} // namespace StupidJSON
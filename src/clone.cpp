@@ -0,0 +1,162 @@
+#include "stupid-json/arena.hpp"
+
+namespace StupidJSON {
+
+static bool SameView(StringView a, StringView b) {
+    return a.begin == b.begin && a.end == b.end;
+}
+
+static void MeasureClone(const Element *elem, size_t &nodes, size_t &bytes) {
+    nodes++;
+
+    switch (elem->type) {
+    case Element::Type::Key:
+        if (elem->firstChild) {
+            MeasureClone(elem->firstChild, nodes, bytes);
+        }
+        [[fallthrough]]; // Measure the name as well
+    case Element::Type::String:
+        bytes += elem->ref.Size();
+        if (!SameView(elem->ref, elem->cleanRef)) {
+            bytes += elem->cleanRef.Size();
+        }
+        break;
+
+    case Element::Type::Number:
+        bytes += elem->ref.Size();
+        break;
+
+    case Element::Type::Object:
+    case Element::Type::Array:
+        for (auto it = elem->firstChild; it != nullptr; it = it->next) {
+            MeasureClone(it, nodes, bytes);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+namespace {
+
+struct CloneCursor {
+    Element *nodes;
+    char *strings;
+
+    StringView Copy(StringView str) {
+        if (str.begin == nullptr) {
+            return {};
+        }
+
+        auto begin = strings;
+        memcpy(strings, str.begin, str.Size());
+        strings += str.Size();
+        return {begin, str.Size()};
+    }
+};
+
+} // namespace
+
+static Element *CloneNode(const Element *src, CloneCursor &cursor);
+
+// Copy src into dst, taking the nodes below it from the cursor
+static void CloneFields(const Element *src, Element *dst,
+                        CloneCursor &cursor) {
+    dst->type = src->type;
+    dst->next = nullptr;
+    dst->firstChild = nullptr;
+    dst->lastChild = nullptr;
+    dst->childCount = 0;
+    dst->ref = {};
+
+    switch (src->type) {
+    case Element::Type::Key:
+        if (src->firstChild) {
+            dst->firstChild = CloneNode(src->firstChild, cursor);
+        }
+        [[fallthrough]]; // Copy the name as well
+    case Element::Type::String:
+        dst->ref = cursor.Copy(src->ref);
+        if (SameView(src->ref, src->cleanRef)) {
+            dst->cleanRef = dst->ref; // Clean strings share their storage
+        } else {
+            dst->cleanRef = cursor.Copy(src->cleanRef);
+        }
+        break;
+
+    case Element::Type::Number:
+        dst->ref = cursor.Copy(src->ref);
+        dst->intValue = src->intValue; // Keep the decoded value, if any
+        dst->decoded = src->decoded;
+        break;
+
+    case Element::Type::Error:
+        dst->ref = src->ref; // Error messages are string literals
+        break;
+
+    case Element::Type::Object:
+    case Element::Type::Array:
+        for (auto it = src->firstChild; it != nullptr; it = it->next) {
+            Element *child = CloneNode(it, cursor);
+
+            if (dst->lastChild) {
+                dst->lastChild->next = child;
+            } else {
+                dst->firstChild = child;
+            }
+
+            dst->lastChild = child;
+            dst->childCount++;
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+static Element *CloneNode(const Element *src, CloneCursor &cursor) {
+    Element *dst = cursor.nodes++;
+    CloneFields(src, dst, cursor);
+    return dst;
+}
+
+// Room for the nodes below the root and every string, the root itself is
+// only allocated if extra is 1
+static bool StartClone(const Element *src, ArenaAllocator &dst, size_t extra,
+                       CloneCursor &cursor) {
+    size_t nodes = 0, bytes = 0;
+    MeasureClone(src, nodes, bytes);
+
+    cursor.nodes = dst.CreateElements(nodes - 1 + extra);
+    if (nodes - 1 + extra && !cursor.nodes) {
+        return false;
+    }
+
+    cursor.strings = bytes ? dst.AllocateString(bytes) : nullptr;
+    return !bytes || cursor.strings;
+}
+
+Element *Element::CloneInto(ArenaAllocator &dst) const {
+    CloneCursor cursor;
+    if (!StartClone(this, dst, 1, cursor)) {
+        return nullptr;
+    }
+
+    return CloneNode(this, cursor);
+}
+
+bool Element::CloneOver(Element *target, ArenaAllocator &dst) const {
+    CloneCursor cursor;
+    if (!StartClone(this, dst, 0, cursor)) {
+        return false;
+    }
+
+    auto next = target->next;
+    CloneFields(this, target, cursor);
+    target->next = next;
+    return true;
+}
+
+} // namespace StupidJSON
@@ -0,0 +1,76 @@
+#include "stupid-json/containers.hpp"
+#include "stupid-json/hash.hpp"
+
+namespace StupidJSON {
+
+Element *ObjectMap::Find(StringView key) const {
+    if (!slots) {
+        return nullptr;
+    }
+
+    uint32_t hash = static_cast<uint32_t>(Hash64(key));
+
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        auto &slot = slots[i];
+        if (!slot.value) {
+            return nullptr;
+        }
+
+        if (slot.hash == hash && slot.key == key) {
+            return slot.value;
+        }
+    }
+}
+
+ObjectMap Element::GetObjectAsFlatMap(ArenaAllocator &arena) {
+    ObjectMap map;
+
+    if (type != Type::Object || !firstChild) {
+        return map;
+    }
+
+    // At most half full, so that probe sequences stay short
+    size_t capacity = 8;
+    while (capacity < childCount * 2) {
+        capacity <<= 1;
+    }
+
+    auto slots = arena.AllocateArray<ObjectMap::Slot>(capacity);
+    if (!slots) {
+        return map;
+    }
+
+    for (size_t i = 0; i < capacity; ++i) {
+        slots[i].value = nullptr;
+    }
+
+    map.slots = slots;
+    map.mask = capacity - 1;
+
+    for (auto it = firstChild; it != nullptr; it = it->next) {
+        assert(it->type == Type::Key);
+        if (!it->firstChild) {
+            continue;
+        }
+
+        // Parsed keys are unescaped already, this never copies them
+        StringView key = it->GetString(arena);
+        uint32_t hash = static_cast<uint32_t>(Hash64(key));
+        size_t i = hash & map.mask;
+
+        while (slots[i].value &&
+               !(slots[i].hash == hash && slots[i].key == key)) {
+            i = (i + 1) & map.mask;
+        }
+
+        if (!slots[i].value) {
+            map.count++;
+        }
+
+        slots[i] = {key, it->firstChild, hash};
+    }
+
+    return map;
+}
+
+} // namespace StupidJSON
@@ -0,0 +1,21 @@
+#include "stupid-json/document.hpp"
+
+namespace StupidJSON {
+
+bool Document::ParseFile(const char *path, ArenaAllocator &arena) {
+    root = arena.CreateElement();
+    if (!root) {
+        file.Close();
+        return false;
+    }
+
+    if (!file.Open(path, MappedFile::Access::Sequential)) {
+        root->type = Element::Type::Error;
+        root->ref = "Failed to map file";
+        return false;
+    }
+
+    return root->ParseBody(file.View(), arena);
+}
+
+} // namespace StupidJSON
@@ -0,0 +1,211 @@
+#include "stupid-json/format.hpp"
+#include "stupid-json/tokenizer.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace StupidJSON {
+
+using namespace Tokenizer;
+
+#if defined(__SSE2__)
+// Bit i is set for each char in the block that is whitespace
+static inline uint32_t SpaceMask(__m128i b) {
+    __m128i ws = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8(' ')),
+                     _mm_cmpeq_epi8(b, _mm_set1_epi8('\n'))),
+        _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('\t')),
+                     _mm_cmpeq_epi8(b, _mm_set1_epi8('\r'))));
+    return static_cast<uint32_t>(_mm_movemask_epi8(ws));
+}
+
+static inline uint32_t CharMask(__m128i b, char c) {
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(b, _mm_set1_epi8(c))));
+}
+#endif
+
+size_t Minify(StringView in, char *out) {
+    const char *it = in.begin;
+    const char *end = in.end;
+    char *o = out;
+    bool inString = false;
+
+#if defined(__SSE2__)
+    // The output never gets ahead of the input, so storing a block that is
+    // consumed completely is safe even when minifying in place
+    while (end - it >= 16) {
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(it));
+
+        if (inString) {
+            uint32_t special = CharMask(b, '\"') | CharMask(b, '\\');
+
+            if (special == 0) {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(o), b);
+                it += 16;
+                o += 16;
+                continue;
+            }
+
+            // Only part of the block is used, so the rest of it must not be
+            // overwritten
+            int n = __builtin_ctz(special);
+            memmove(o, it, n + 1);
+            o += n + 1;
+            it += n + 1;
+
+            if (it[-1] == '\"') {
+                inString = false;
+            } else if (it != end) {
+                *(o++) = *(it++); // The escaped char
+            }
+            continue;
+        }
+
+        uint32_t quotes = CharMask(b, '\"');
+        uint32_t keep = ~SpaceMask(b) & 0xffff;
+        int count = 16;
+
+        if (quotes != 0) {
+            count = __builtin_ctz(quotes);
+            keep &= (1u << count) - 1;
+        }
+
+        if (keep == 0xffff) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(o), b);
+            o += 16;
+        } else {
+            while (keep != 0) {
+                *(o++) = it[__builtin_ctz(keep)];
+                keep &= keep - 1;
+            }
+        }
+
+        it += count;
+
+        if (quotes != 0) {
+            *(o++) = *(it++);
+            inString = true;
+        }
+    }
+#endif
+
+    while (it != end) {
+        char c = *(it++);
+
+        if (inString) {
+            *(o++) = c;
+            if (c == '\"') {
+                inString = false;
+            } else if (c == '\\' && it != end) {
+                *(o++) = *(it++);
+            }
+        } else if (!isSpace(c)) {
+            *(o++) = c;
+            inString = c == '\"';
+        }
+    }
+
+    return static_cast<size_t>(o - out);
+}
+
+namespace {
+
+// Counts everything, but only writes what fits
+struct BoundedOut {
+    char *out;
+    size_t outSize;
+    size_t size = 0;
+
+    inline void Put(char c) {
+        if (size < outSize) {
+            out[size] = c;
+        }
+        size++;
+    }
+
+    inline void Put(const char *begin, const char *end) {
+        size_t n = static_cast<size_t>(end - begin);
+        if (size < outSize) {
+            memcpy(out + size, begin, std::min(n, outSize - size));
+        }
+        size += n;
+    }
+
+    inline void NewLine(int level, int indent) {
+        Put('\n');
+        for (int i = 0; i < level * indent; ++i) {
+            Put(' ');
+        }
+    }
+};
+
+} // namespace
+
+size_t Reindent(StringView in, char *out, size_t outSize, int indent) {
+    BoundedOut o{out, outSize};
+    const char *it = in.begin;
+    const char *end = in.end;
+    int level = 0;
+
+    while (it != end) {
+        char c = *it;
+
+        switch (c) {
+        case '\"': {
+            auto strEnd = SkipString(it + 1, end);
+            if (strEnd != end) {
+                strEnd++; // Keep the closing quote
+            }
+
+            o.Put(it, strEnd);
+            it = strEnd;
+            continue;
+        }
+
+        case '{':
+        case '[': {
+            o.Put(c);
+
+            // Empty containers stay on one line
+            auto next = FwdSpaces(it + 1, end);
+            if (next != end && (*next == '}' || *next == ']')) {
+                o.Put(*next);
+                it = next + 1;
+                continue;
+            }
+
+            o.NewLine(++level, indent);
+        } break;
+
+        case '}':
+        case ']':
+            o.NewLine(level > 0 ? --level : 0, indent);
+            o.Put(c);
+            break;
+
+        case ',':
+            o.Put(c);
+            o.NewLine(level, indent);
+            break;
+
+        case ':':
+            o.Put(c);
+            o.Put(' ');
+            break;
+
+        default:
+            if (!isSpace(c)) {
+                o.Put(c);
+            }
+            break;
+        }
+
+        it++;
+    }
+
+    return o.size;
+}
+
+} // namespace StupidJSON
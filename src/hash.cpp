@@ -0,0 +1,102 @@
+#include "stupid-json/hash.hpp"
+
+namespace StupidJSON {
+
+static const uint64_t prime1 = 11400714785074694791ull;
+static const uint64_t prime2 = 14029467366897019727ull;
+static const uint64_t prime3 = 1609587929392839161ull;
+static const uint64_t prime4 = 9650029242287828579ull;
+static const uint64_t prime5 = 2870177450012600261ull;
+
+static inline uint64_t Rotl(uint64_t v, int r) {
+    return (v << r) | (v >> (64 - r));
+}
+
+// XXH64 is defined on little endian reads
+static inline uint64_t Read64(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint32_t Read32(const char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static inline uint64_t Round(uint64_t acc, uint64_t input) {
+    acc += input * prime2;
+    acc = Rotl(acc, 31);
+    return acc * prime1;
+}
+
+static inline uint64_t MergeRound(uint64_t acc, uint64_t val) {
+    acc ^= Round(0, val);
+    return acc * prime1 + prime4;
+}
+
+uint64_t Hash64(StringView data, uint64_t seed) {
+    const char *p = data.begin;
+    const char *end = data.end;
+    uint64_t h;
+
+    if (data.Size() >= 32) {
+        uint64_t v1 = seed + prime1 + prime2;
+        uint64_t v2 = seed + prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - prime1;
+
+        // Four independent lanes, so the multiplies can overlap
+        while (end - p >= 32) {
+            v1 = Round(v1, Read64(p));
+            v2 = Round(v2, Read64(p + 8));
+            v3 = Round(v3, Read64(p + 16));
+            v4 = Round(v4, Read64(p + 24));
+            p += 32;
+        }
+
+        h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+        h = MergeRound(h, v1);
+        h = MergeRound(h, v2);
+        h = MergeRound(h, v3);
+        h = MergeRound(h, v4);
+    } else {
+        h = seed + prime5;
+    }
+
+    h += data.Size();
+
+    while (end - p >= 8) {
+        h ^= Round(0, Read64(p));
+        h = Rotl(h, 27) * prime1 + prime4;
+        p += 8;
+    }
+
+    if (end - p >= 4) {
+        h ^= uint64_t(Read32(p)) * prime1;
+        h = Rotl(h, 23) * prime2 + prime3;
+        p += 4;
+    }
+
+    while (p != end) {
+        h ^= uint64_t(static_cast<unsigned char>(*(p++))) * prime5;
+        h = Rotl(h, 11) * prime1;
+    }
+
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+} // namespace StupidJSON
@@ -0,0 +1,199 @@
+#include "stupid-json/incremental.hpp"
+
+namespace StupidJSON {
+
+bool EditableDocument::Parse(StringView text, ArenaAllocator &arena) {
+    body.assign(text.begin, text.Size());
+
+    root = arena.CreateElement();
+    if (!root) {
+        return false;
+    }
+
+    lastReparsed = body.size();
+    return root->ParseBody({body.data(), body.size()}, arena);
+}
+
+namespace {
+
+// Moves the references of nodes that are kept from the text before an edit
+// to the text after it
+struct Rebase {
+    uintptr_t oldBegin;
+    uintptr_t oldEnd;
+    const char *newBegin;
+    size_t offset;    // Where the edit starts
+    size_t editEnd;   // Where the removed bytes ended, before the edit
+    ptrdiff_t delta;  // Change in size
+
+    // Ends of views at the edit stay, beginnings move with the inserted text
+    inline const char *Map(const char *p, bool isEnd) const {
+        auto at = reinterpret_cast<uintptr_t>(p);
+        if (at < oldBegin || at > oldEnd) {
+            return p; // In the arena
+        }
+
+        size_t off = at - oldBegin;
+        if (isEnd ? off > offset : off >= editEnd) {
+            off += delta;
+        }
+
+        return newBegin + off;
+    }
+
+    inline StringView Map(StringView v) const {
+        return {Map(v.begin, false), Map(v.end, true)};
+    }
+
+    void Tree(Element *e, const Element *skip) const {
+        if (e == skip) {
+            return;
+        }
+
+        e->ref = Map(e->ref);
+
+        switch (e->type) {
+        case Element::Type::Key:
+            e->cleanRef = Map(e->cleanRef);
+            if (e->firstChild) {
+                Tree(e->firstChild, skip);
+            }
+            break;
+        case Element::Type::String:
+            e->cleanRef = Map(e->cleanRef);
+            break;
+        case Element::Type::Object:
+        case Element::Type::Array:
+            for (auto it = e->firstChild; it != nullptr; it = it->next) {
+                Tree(it, skip);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+};
+
+} // namespace
+
+bool EditableDocument::ApplyEdit(const TextEdit &edit, ArenaAllocator &arena) {
+    if (!root || edit.offset > body.size() ||
+        edit.removed > body.size() - edit.offset) {
+        return false;
+    }
+
+    const char *base = body.data();
+    size_t editEnd = edit.offset + edit.removed;
+
+    // Containers parsed from this text that hold the edit strictly between
+    // their brackets
+    auto encloses = [&](const Element *e) {
+        if (e->type != Element::Type::Object &&
+            e->type != Element::Type::Array) {
+            return false;
+        }
+
+        if (e->ref.begin < base || e->ref.end > base + body.size()) {
+            return false;
+        }
+
+        return static_cast<size_t>(e->ref.begin - base) < edit.offset &&
+               editEnd < static_cast<size_t>(e->ref.end - base);
+    };
+
+    // Containers from the root down to the smallest one around the edit
+    std::vector<Element *> path;
+    if (encloses(root)) {
+        path.push_back(root);
+    }
+
+    while (!path.empty()) {
+        auto container = path.back();
+        bool isObject = container->type == Element::Type::Object;
+        Element *inner = nullptr;
+
+        for (auto it = container->firstChild; it != nullptr; it = it->next) {
+            auto value = isObject ? it->firstChild : it;
+            if (value && encloses(value)) {
+                inner = value;
+                break;
+            }
+        }
+
+        if (!inner) {
+            break;
+        }
+
+        path.push_back(inner);
+    }
+
+    Rebase rebase;
+    rebase.oldBegin = reinterpret_cast<uintptr_t>(base);
+    rebase.oldEnd = rebase.oldBegin + body.size();
+    rebase.offset = edit.offset;
+    rebase.editEnd = editEnd;
+    rebase.delta = static_cast<ptrdiff_t>(edit.inserted.Size()) -
+                   static_cast<ptrdiff_t>(edit.removed);
+
+    body.replace(edit.offset, edit.removed, edit.inserted.begin,
+                 edit.inserted.Size());
+    rebase.newBegin = body.data();
+
+    // Edits can change where a container ends, such as by closing it early,
+    // so a container only counts if it parses to exactly its new span.
+    // Otherwise the container around it is tried.
+    Element *fresh = nullptr;
+    while (!path.empty()) {
+        StringView span = rebase.Map(path.back()->ref);
+
+        fresh = arena.CreateElement();
+        if (!fresh) {
+            return false;
+        }
+
+        const char *term = nullptr;
+        if (fresh->ParseBody(span, arena, &term) && term == span.end) {
+            lastReparsed = span.Size();
+            break;
+        }
+
+        path.pop_back();
+    }
+
+    if (path.empty()) {
+        lastReparsed = body.size();
+        return root->ParseBody({body.data(), body.size()}, arena);
+    }
+
+    auto target = path.back();
+
+    if (rebase.newBegin == base) {
+        // Only what comes after the edit moves, which are the ends of the
+        // containers around it and the siblings that follow them
+        for (size_t i = 0; i + 1 < path.size(); ++i) {
+            auto container = path[i];
+            bool isObject = container->type == Element::Type::Object;
+            container->ref = rebase.Map(container->ref);
+
+            auto it = container->firstChild;
+            while ((isObject ? it->firstChild : it) != path[i + 1]) {
+                it = it->next;
+            }
+
+            for (it = it->next; it != nullptr; it = it->next) {
+                rebase.Tree(it, nullptr);
+            }
+        }
+    } else {
+        // The text was reallocated, so everything moves
+        rebase.Tree(root, target);
+    }
+
+    auto next = target->next;
+    *target = *fresh;
+    target->next = next;
+
+    return true;
+}
+
+} // namespace StupidJSON
@@ -0,0 +1,73 @@
+#include "stupid-json/mmap.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace StupidJSON {
+
+MappedFile::MappedFile(MappedFile &&o) noexcept : data(o.data), size(o.size) {
+    o.data = nullptr;
+    o.size = 0;
+}
+
+MappedFile::~MappedFile() { Close(); }
+
+MappedFile &MappedFile::operator=(MappedFile &&o) noexcept {
+    if (this != &o) {
+        Close();
+        data = o.data;
+        size = o.size;
+        o.data = nullptr;
+        o.size = 0;
+    }
+
+    return *this;
+}
+
+bool MappedFile::Open(const char *path, Access access) {
+    Close();
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping keeps its own reference to the file
+    close(fd);
+
+    if (ptr == MAP_FAILED) {
+        return false;
+    }
+
+    data = ptr;
+    size = st.st_size;
+
+    // Advice is only a hint, failure is not an error
+    if (access == Access::Sequential) {
+        madvise(data, size, MADV_SEQUENTIAL);
+    }
+    madvise(data, size, MADV_WILLNEED);
+
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data) {
+        munmap(data, size);
+    }
+
+    data = nullptr;
+    size = 0;
+}
+
+} // namespace StupidJSON
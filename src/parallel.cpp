@@ -0,0 +1,382 @@
+#include "stupid-json/parallel.hpp"
+#include "stupid-json/tokenizer.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace StupidJSON {
+
+using namespace Tokenizer;
+
+namespace {
+
+// Children are grouped into chunks of at least this many output bytes, and
+// containers smaller than two chunks are never split
+static const size_t parallelChunkSize = 32 * 1024;
+
+// Consecutive children of a container, keys for objects
+struct Chunk {
+    Element *first;
+    size_t count;
+    size_t size;
+};
+
+static inline size_t StringSize(const Element *e) {
+    if (e->ref.begin) {
+        return e->ref.Size();
+    }
+
+    return EscapedSize(e->cleanRef.begin, e->cleanRef.end);
+}
+
+static inline void PutString(std::string &out, const Element *e) {
+    out += '\"';
+    if (e->ref.begin) {
+        out.append(e->ref.begin, e->ref.Size());
+    } else {
+        size_t at = out.size();
+        out.resize(at + EscapedSize(e->cleanRef.begin, e->cleanRef.end));
+        EscapeChars(e->cleanRef.begin, e->cleanRef.end, &out[at]);
+    }
+    out += '\"';
+}
+
+static inline void PutNewLine(std::string &out, int level) {
+    out += '\n';
+    out.append(static_cast<size_t>(level) * 2, ' ');
+}
+
+// Everything in front of a child's value, from the separator to the key
+static void PutChildPrefix(std::string &out, const Element *child,
+                           bool isFirst, bool isObject, int level) {
+    if (!isFirst) {
+        out += ',';
+    }
+
+    PutNewLine(out, level);
+
+    if (isObject) {
+        PutString(out, child);
+        out += ": ";
+    }
+}
+
+static bool PutValue(std::string &out, const Element *e, int level);
+
+static bool PutChildren(std::string &out, const Element *first, size_t count,
+                        bool isFirst, bool isObject, int level) {
+    for (auto it = first; count-- != 0; it = it->next) {
+        PutChildPrefix(out, it, isFirst, isObject, level);
+        isFirst = false;
+
+        if (!PutValue(out, isObject ? it->firstChild : it, level)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool PutValue(std::string &out, const Element *e, int level) {
+    switch (e->type) {
+    case Element::Type::String:
+        PutString(out, e);
+        return true;
+    case Element::Type::Number:
+        out.append(e->ref.begin, e->ref.Size());
+        return true;
+    case Element::Type::Object:
+    case Element::Type::Array: {
+        bool isObject = e->type == Element::Type::Object;
+        out += isObject ? '{' : '[';
+
+        size_t count = 0;
+        for (auto it = e->firstChild; it != nullptr; it = it->next) {
+            count++;
+        }
+
+        if (!PutChildren(out, e->firstChild, count, true, isObject,
+                         level + 1)) {
+            return false;
+        }
+
+        // Empty containers still get a blank line, as with Serialize
+        if (count == 0) {
+            out += '\n';
+        }
+
+        PutNewLine(out, level);
+        out += isObject ? '}' : ']';
+        return true;
+    }
+    case Element::Type::Null:
+        out += "null";
+        return true;
+    case Element::Type::True:
+        out += "true";
+        return true;
+    case Element::Type::False:
+        out += "false";
+        return true;
+    default:
+        return false;
+    }
+}
+
+// A part of the output, either rendered while planning or by a worker
+struct Piece {
+    const Element *container = nullptr;
+    const Element *first = nullptr; // nullptr when text is rendered already
+    size_t count = 0;
+    size_t size = 0;
+    bool isFirst = false;
+    bool isObject = false;
+    int level = 0;
+    bool done = false;
+    bool ok = true;
+    std::string text;
+};
+
+struct ParallelSerializer {
+    // Chunks of every container large enough to split
+    std::unordered_map<const Element *, std::vector<Chunk>> chunks;
+    std::vector<Piece> pieces;
+    size_t target = 0;
+
+    // Exact output size of a value, or 0 if it can't be serialized
+    size_t Measure(const Element *e, int level) {
+        switch (e->type) {
+        case Element::Type::String:
+            return StringSize(e) + 2;
+        case Element::Type::Number:
+            return e->ref.Size();
+        case Element::Type::Object:
+        case Element::Type::Array:
+            break;
+        case Element::Type::Null:
+        case Element::Type::True:
+            return 4;
+        case Element::Type::False:
+            return 5;
+        default:
+            return 0;
+        }
+
+        bool isObject = e->type == Element::Type::Object;
+        size_t indent = static_cast<size_t>(level + 1) * 2;
+        std::vector<Chunk> split;
+        Chunk chunk{e->firstChild, 0, 0};
+        size_t total = 0;
+
+        for (auto it = e->firstChild; it != nullptr; it = it->next) {
+            auto value = it;
+            size_t size = (it == e->firstChild ? 1 : 2) + indent;
+
+            if (isObject) {
+                value = it->firstChild;
+                if (!value) {
+                    return 0;
+                }
+                size += StringSize(it) + 4;
+            }
+
+            size_t valueSize = Measure(value, level + 1);
+            if (valueSize == 0) {
+                return 0;
+            }
+
+            size += valueSize;
+            total += size;
+
+            // Large children get a chunk of their own, so they can be split
+            // further
+            if (size >= parallelChunkSize && chunk.count != 0) {
+                split.push_back(chunk);
+                chunk = {it, 0, 0};
+            }
+
+            chunk.count++;
+            chunk.size += size;
+
+            if (chunk.size >= parallelChunkSize) {
+                split.push_back(chunk);
+                chunk = {it->next, 0, 0};
+            }
+        }
+
+        if (total >= parallelChunkSize * 2) {
+            if (chunk.count != 0) {
+                split.push_back(chunk);
+            }
+            chunks.emplace(e, std::move(split));
+        }
+
+        // Brackets and the line before the closing one
+        total += 3 + static_cast<size_t>(level) * 2;
+        return e->firstChild ? total : total + 1;
+    }
+
+    void AddText(std::string text) {
+        if (!pieces.empty() && !pieces.back().first) {
+            pieces.back().text += text;
+            return;
+        }
+
+        Piece piece;
+        piece.done = true;
+        piece.text = std::move(text);
+        pieces.push_back(std::move(piece));
+    }
+
+    void AddRange(const Element *container, const Chunk &chunk, int level) {
+        // Small chunks of the same container are merged into work of about
+        // target bytes. Planning a child always ends with text, so a range
+        // of the same container is the chunk right before this one.
+        auto &last = pieces.back();
+        if (last.container == container &&
+            last.size + chunk.size <= target) {
+            last.count += chunk.count;
+            last.size += chunk.size;
+            return;
+        }
+
+        Piece piece;
+        piece.container = container;
+        piece.first = chunk.first;
+        piece.count = chunk.count;
+        piece.size = chunk.size;
+        piece.isFirst = chunk.first == container->firstChild;
+        piece.isObject = container->type == Element::Type::Object;
+        piece.level = level;
+        pieces.push_back(std::move(piece));
+    }
+
+    // Split a container into pieces, recursing into children that are too
+    // large for one piece
+    void Plan(const Element *e, int level) {
+        bool isObject = e->type == Element::Type::Object;
+        AddText(isObject ? "{" : "[");
+
+        for (auto &chunk : chunks.find(e)->second) {
+            auto value = isObject ? chunk.first->firstChild : chunk.first;
+
+            if (chunk.count == 1 && chunk.size > target &&
+                chunks.count(value)) {
+                std::string prefix;
+                PutChildPrefix(prefix, chunk.first,
+                               chunk.first == e->firstChild, isObject,
+                               level + 1);
+                AddText(std::move(prefix));
+                Plan(value, level + 1);
+            } else {
+                AddRange(e, chunk, level + 1);
+            }
+        }
+
+        std::string suffix;
+        PutNewLine(suffix, level);
+        suffix += isObject ? '}' : ']';
+        AddText(std::move(suffix));
+    }
+
+    static void Render(Piece &piece) {
+        piece.text.reserve(piece.size);
+        piece.ok = PutChildren(piece.text, piece.first, piece.count,
+                               piece.isFirst, piece.isObject, piece.level);
+    }
+};
+
+} // namespace
+
+bool SerializeParallel(Element *root, std::ostream &s, unsigned threads) {
+    if (threads == 0) {
+        // Looking this up can mean reading files, so only do it once
+        static const unsigned cores =
+            std::max(1u, std::thread::hardware_concurrency());
+        threads = cores;
+    }
+
+    ParallelSerializer ser;
+    size_t total = ser.Measure(root, 0);
+    if (total == 0) {
+        return false;
+    }
+
+    if (threads == 1 || !ser.chunks.count(root)) {
+        std::string out;
+        out.reserve(total);
+        if (!PutValue(out, root, 0)) {
+            return false;
+        }
+
+        s.write(out.data(), out.size());
+        return s.good();
+    }
+
+    // A few pieces per thread, so that uneven pieces still balance
+    ser.target = std::max(total / (threads * 4), parallelChunkSize);
+    ser.Plan(root, 0);
+
+    auto &pieces = ser.pieces;
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t next = 0;
+
+    auto work = [&] {
+        while (true) {
+            size_t index;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                while (next < pieces.size() && pieces[next].done) {
+                    next++;
+                }
+                if (next == pieces.size()) {
+                    return;
+                }
+                index = next++;
+            }
+
+            ParallelSerializer::Render(pieces[index]);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pieces[index].done = true;
+            }
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(work);
+    }
+
+    // Write the pieces in order as they complete, freeing them as we go
+    bool ok = true;
+    for (auto &piece : pieces) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return piece.done; });
+        }
+
+        ok = ok && piece.ok;
+        if (ok) {
+            s.write(piece.text.data(), piece.text.size());
+        }
+        std::string().swap(piece.text);
+    }
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    return ok && s.good();
+}
+
+} // namespace StupidJSON
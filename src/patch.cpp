@@ -0,0 +1,187 @@
+#include "stupid-json/arena.hpp"
+
+#include <string_view>
+#include <unordered_map>
+
+namespace StupidJSON {
+
+// Objects at least this wide get a temporary key index when patched with
+// more than a couple of keys, instead of a linear scan per patched key
+static const size_t indexMinTargetKeys = 16;
+static const size_t indexMinPatchKeys = 4;
+
+static bool PatchKeyName(const Element *key, ArenaAllocator &arena,
+                         StringView &name) {
+    if (key->type != Element::Type::Key || !key->firstChild) {
+        return false;
+    }
+
+    if (key->cleanRef.begin != nullptr) {
+        name = key->cleanRef;
+        return true;
+    }
+
+    return UnescapeString(key->ref, name, arena);
+}
+
+static StringView CopyString(StringView str, ArenaAllocator &arena) {
+    if (str.begin == nullptr) {
+        return {};
+    }
+
+    return arena.PushString(str);
+}
+
+// Copy a value from the patch over dst, keeping dst in its parent's list
+static bool CopyValue(const Element *src, Element *dst,
+                      ArenaAllocator &arena) {
+    if (src->type == Element::Type::Key ||
+        src->type == Element::Type::Error) {
+        dst->type = Element::Type::Error;
+        dst->ref = "Invalid element in merge patch";
+        return false;
+    }
+
+    return src->CloneOver(dst, arena);
+}
+
+// Remove key from an object, prev is the key before it or nullptr if it is
+// the first one
+static void Unlink(Element *object, Element *prev, Element *key) {
+    if (prev) {
+        prev->next = key->next;
+    } else {
+        object->firstChild = key->next;
+    }
+
+    if (object->lastChild == key) {
+        object->lastChild = prev;
+    }
+
+    object->childCount--;
+    key->next = nullptr;
+}
+
+bool Element::ApplyMergePatch(const Element *patch, ArenaAllocator &arena) {
+    if (type == Type::Key || !patch) {
+        return false;
+    }
+
+    if (patch->type != Type::Object) {
+        return CopyValue(patch, this, arena);
+    }
+
+    if (type != Type::Object) {
+        type = Type::Object;
+        ref = {};
+        firstChild = nullptr;
+        lastChild = nullptr;
+        childCount = 0;
+    }
+
+    // Maps each key name to the key before it, so that keys can be unlinked
+    // from the singly linked list without a scan
+    std::unordered_map<std::string_view, Element *> index;
+    bool useIndex = childCount >= indexMinTargetKeys &&
+                    patch->childCount >= indexMinPatchKeys;
+
+    if (useIndex) {
+        index.reserve(childCount + patch->childCount);
+
+        // The index only holds the first of duplicate keys, and once that is
+        // removed the scan would find the next one. Objects with duplicate
+        // keys are rare, so they are always scanned.
+        Element *prev = nullptr;
+        for (auto it = firstChild; it != nullptr; it = it->next) {
+            if (!index.emplace(it->GetString(arena).ToStd(), prev).second) {
+                useIndex = false;
+                index.clear();
+                break;
+            }
+            prev = it;
+        }
+    }
+
+    for (auto p = patch->firstChild; p != nullptr; p = p->next) {
+        StringView name;
+        if (!PatchKeyName(p, arena, name)) {
+            return false;
+        }
+
+        Element *prev = nullptr;
+        Element *key = nullptr;
+
+        if (useIndex) {
+            auto found = index.find(name.ToStd());
+            if (found != index.end()) {
+                prev = found->second;
+                key = prev ? prev->next : firstChild;
+            }
+        } else {
+            for (auto it = firstChild; it != nullptr; it = it->next) {
+                if (it->GetString(arena) == name) {
+                    key = it;
+                    break;
+                }
+
+                prev = it;
+            }
+        }
+
+        const Element *value = p->firstChild;
+
+        if (value->type == Type::Null) {
+            if (!key) {
+                continue;
+            }
+
+            if (useIndex) {
+                // The key after the removed one now follows prev
+                if (key->next) {
+                    auto after = index.find(key->next->cleanRef.ToStd());
+                    if (after != index.end() && after->second == key) {
+                        after->second = prev;
+                    }
+                }
+
+                index.erase(name.ToStd());
+            }
+
+            Unlink(this, prev, key);
+            continue;
+        }
+
+        if (key) {
+            if (!key->firstChild->ApplyMergePatch(value, arena)) {
+                return false;
+            }
+            continue;
+        }
+
+        // New member, patched onto an empty value so that nested nulls are
+        // dropped as the RFC requires
+        Element *el = arena.CreateElement();
+        if (!el) {
+            return false;
+        }
+
+        el->type = Type::Null;
+        el->next = nullptr;
+        if (!el->ApplyMergePatch(value, arena)) {
+            return false;
+        }
+
+        auto stored = CopyString(name, arena);
+        if (useIndex) {
+            index.emplace(stored.ToStd(), lastChild);
+        }
+
+        if (!ObjectPush(stored, el, arena)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+} // namespace StupidJSON
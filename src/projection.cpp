@@ -0,0 +1,115 @@
+#include "stupid-json/projection.hpp"
+#include "stupid-json/tokenizer.hpp"
+
+#include <algorithm>
+
+namespace StupidJSON {
+
+using namespace Tokenizer;
+
+// Exact keys hold the paths of the wildcard beside them as well, so that
+// Match only has to return one node. A wildcard path goes below every key,
+// and a new key starts out with what the wildcard has.
+static void Insert(Projection::Node &node,
+                   const std::vector<std::string> &tokens, size_t index) {
+    if (node.keepAll) {
+        return; // Already covered by a shorter path
+    }
+
+    if (index == tokens.size()) {
+        // Everything below is kept anyway
+        node.keepAll = true;
+        node.children.clear();
+        return;
+    }
+
+    auto &token = tokens[index];
+    auto wildcard = std::find_if(
+        node.children.begin(), node.children.end(),
+        [](const Projection::Node &n) { return n.wildcard; });
+
+    if (token == "*") {
+        if (wildcard == node.children.end()) {
+            Projection::Node n;
+            n.key = token;
+            n.wildcard = true;
+            node.children.push_back(std::move(n));
+        }
+
+        for (auto &child : node.children) {
+            Insert(child, tokens, index + 1);
+        }
+        return;
+    }
+
+    auto child = std::find_if(
+        node.children.begin(), node.children.end(),
+        [&token](const Projection::Node &n) {
+            return !n.wildcard && n.key == token;
+        });
+
+    if (child == node.children.end()) {
+        Projection::Node n;
+        if (wildcard != node.children.end()) {
+            n = *wildcard;
+            n.wildcard = false;
+        }
+        n.key = token;
+        node.children.push_back(std::move(n));
+        child = node.children.end() - 1;
+    }
+
+    Insert(*child, tokens, index + 1);
+}
+
+bool Projection::Add(StringView pointer) {
+    if (pointer.Empty()) {
+        root.keepAll = true;
+        root.children.clear();
+        return true;
+    }
+
+    if (*pointer.begin != '/') {
+        return false;
+    }
+
+    // Decode everything first, so that a malformed path leaves no trace
+    std::vector<std::string> tokens;
+    for (auto it = pointer.begin + 1;;) {
+        auto tokenEnd = FindChar(it, pointer.end, '/');
+
+        tokens.emplace_back();
+        if (!DecodePointerToken(it, tokenEnd, tokens.back())) {
+            return false;
+        }
+
+        if (tokenEnd == pointer.end) {
+            break;
+        }
+
+        it = tokenEnd + 1;
+    }
+
+    Insert(root, tokens, 0);
+    return true;
+}
+
+void Projection::Clear() { root = Node(); }
+
+const Projection::Node *Projection::Match(const Node *node, StringView raw,
+                                          ArenaAllocator &arena) {
+    const Node *wildcard = nullptr;
+
+    for (auto &child : node->children) {
+        if (child.wildcard) {
+            wildcard = &child;
+        } else if (KeyEquals(raw, {child.key.data(), child.key.size()},
+                             arena)) {
+            return &child;
+        }
+    }
+
+    return wildcard;
+}
+
+} // namespace StupidJSON
@@ -0,0 +1,254 @@
+#include "stupid-json/query.hpp"
+#include "stupid-json/tokenizer.hpp"
+
+namespace StupidJSON {
+
+using namespace Tokenizer;
+
+static bool ParseIndex(const std::string &token, uint32_t &index) {
+    if (token.empty() || token.size() > 10) {
+        return false;
+    }
+
+    // Leading zeros are not allowed, except for the index 0 itself
+    if (token[0] == '0' && token.size() > 1) {
+        return false;
+    }
+
+    uint64_t val = 0;
+    for (char c : token) {
+        if (!isDigit(c)) {
+            return false;
+        }
+
+        val = val * 10 + (c - '0');
+    }
+
+    if (val > UINT32_MAX) {
+        return false;
+    }
+
+    index = static_cast<uint32_t>(val);
+    return true;
+}
+
+bool Query::Compile(StringView pointer) {
+    segments.clear();
+
+    if (pointer.Empty()) {
+        return true;
+    }
+
+    if (*pointer.begin != '/') {
+        return false;
+    }
+
+    auto it = pointer.begin + 1;
+
+    while (true) {
+        auto tokenEnd = FindChar(it, pointer.end, '/');
+
+        Segment seg;
+        if (!DecodePointerToken(it, tokenEnd, seg.key)) {
+            segments.clear();
+            return false;
+        }
+
+        // A token that is exactly '*' is a wildcard, which means that a
+        // literal '*' key can't be addressed
+        seg.wildcard = (tokenEnd - it == 1 && *it == '*');
+        seg.isIndex = ParseIndex(seg.key, seg.index);
+        segments.push_back(std::move(seg));
+
+        if (tokenEnd == pointer.end) {
+            break;
+        }
+
+        it = tokenEnd + 1;
+    }
+
+    return true;
+}
+
+const char *Query::MatchValue(const Segment *seg, const Segment *segEnd,
+                              const char *begin, const char *end,
+                              ArenaAllocator &arena,
+                              std::vector<Element *> &hits) {
+    begin = FwdSpaces(begin, end);
+
+    if (seg == segEnd) {
+        Element *elem = arena.CreateElement();
+        if (!elem || !elem->ParseBody({begin, end}, arena, &begin)) {
+            return nullptr;
+        }
+
+        hits.push_back(elem);
+        return begin;
+    }
+
+    if (begin == end) {
+        return nullptr;
+    }
+
+    switch (*begin) {
+    case '{':
+        return MatchObject(seg, segEnd, begin + 1, end, arena, hits);
+    case '[':
+        return MatchArray(seg, segEnd, begin + 1, end, arena, hits);
+    default:
+        // Scalars can't contain the rest of the path
+        return SkipValue(begin, end);
+    }
+}
+
+const char *Query::MatchObject(const Segment *seg, const Segment *segEnd,
+                               const char *begin, const char *end,
+                               ArenaAllocator &arena,
+                               std::vector<Element *> &hits) {
+    bool found = false;
+
+    begin = FwdSpaces(begin, end);
+    if (begin != end && *begin == '}') {
+        return begin + 1;
+    }
+
+    while (begin != end) {
+        if (*begin != '\"') {
+            return nullptr;
+        }
+
+        auto keyEnd = SkipString(begin + 1, end);
+        if (keyEnd == end) {
+            return nullptr;
+        }
+
+        StringView key(begin + 1, keyEnd);
+
+        begin = FwdSpaces(keyEnd + 1, end);
+        if (begin == end || *begin != ':') {
+            return nullptr;
+        }
+
+        begin = FwdSpaces(begin + 1, end);
+
+        // Like FindKey, only the first matching key is used
+        StringView name(seg->key.data(), seg->key.size());
+        if (seg->wildcard || (!found && KeyEquals(key, name, arena))) {
+            found = true;
+            begin = MatchValue(seg + 1, segEnd, begin, end, arena, hits);
+        } else {
+            begin = SkipValue(begin, end);
+        }
+
+        if (!begin) {
+            return nullptr;
+        }
+
+        begin = FwdSpaces(begin, end);
+        if (begin == end) {
+            return nullptr;
+        }
+
+        if (*begin == '}') {
+            return begin + 1;
+        }
+
+        if (*begin != ',') {
+            return nullptr;
+        }
+
+        begin = FwdSpaces(begin + 1, end);
+    }
+
+    return nullptr;
+}
+
+const char *Query::MatchArray(const Segment *seg, const Segment *segEnd,
+                              const char *begin, const char *end,
+                              ArenaAllocator &arena,
+                              std::vector<Element *> &hits) {
+    uint32_t index = 0;
+
+    begin = FwdSpaces(begin, end);
+    if (begin != end && *begin == ']') {
+        return begin + 1;
+    }
+
+    while (begin != end) {
+        if (seg->wildcard || (seg->isIndex && seg->index == index)) {
+            begin = MatchValue(seg + 1, segEnd, begin, end, arena, hits);
+        } else {
+            begin = SkipValue(begin, end);
+        }
+
+        if (!begin) {
+            return nullptr;
+        }
+
+        index++;
+
+        begin = FwdSpaces(begin, end);
+        if (begin == end) {
+            return nullptr;
+        }
+
+        if (*begin == ']') {
+            return begin + 1;
+        }
+
+        if (*begin != ',') {
+            return nullptr;
+        }
+
+        begin = FwdSpaces(begin + 1, end);
+    }
+
+    return nullptr;
+}
+
+void Query::MatchElement(const Segment *seg, const Segment *segEnd,
+                         Element *elem, ArenaAllocator &arena,
+                         std::vector<Element *> &hits) {
+    if (seg == segEnd) {
+        hits.push_back(elem);
+        return;
+    }
+
+    if (elem->type == Element::Type::Object) {
+        if (seg->wildcard) {
+            elem->IterateObject(arena, [&](auto, Element *value) {
+                MatchElement(seg + 1, segEnd, value, arena, hits);
+            });
+        } else if (auto value = elem->FindChildElement(
+                       {seg->key.data(), seg->key.size()}, arena)) {
+            MatchElement(seg + 1, segEnd, value, arena, hits);
+        }
+    } else if (elem->type == Element::Type::Array) {
+        if (seg->wildcard) {
+            elem->IterateArray([&](auto, Element *value) {
+                MatchElement(seg + 1, segEnd, value, arena, hits);
+            });
+        } else if (seg->isIndex) {
+            if (auto value = elem->GetArrayIndex(seg->index)) {
+                MatchElement(seg + 1, segEnd, value, arena, hits);
+            }
+        }
+    }
+}
+
+bool Query::Evaluate(StringView body, ArenaAllocator &arena,
+                     std::vector<Element *> &hits) const {
+    auto segBegin = segments.data();
+    auto segEnd = segBegin + segments.size();
+
+    return MatchValue(segBegin, segEnd, body.begin, body.end, arena, hits) !=
+           nullptr;
+}
+
+void Query::Evaluate(Element *root, ArenaAllocator &arena,
+                     std::vector<Element *> &hits) const {
+    auto segBegin = segments.data();
+    MatchElement(segBegin, segBegin + segments.size(), root, arena, hits);
+}
+
+} // namespace StupidJSON
@@ -0,0 +1,208 @@
+#include "stupid-json/scatter.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <memory>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+namespace StupidJSON {
+
+namespace {
+
+// Slices shorter than this are copied, a separate iovec costs more
+static const size_t scatterCopyLimit = 64;
+
+static const char scatterSpaces[] = "                                "
+                                    "                                ";
+
+struct ScatterOut {
+    int fd;
+    struct iovec iov[IOV_MAX];
+    int iovCount = 0;
+
+    // Copies of short slices, stable until the next flush
+    char pool[16 * 1024];
+    size_t poolSize = 0;
+
+    bool Flush() {
+        struct iovec *it = iov;
+        int count = iovCount;
+
+        while (count > 0) {
+            ssize_t n = writev(fd, it, count);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+
+            // Skip what was written, the last slice may be partial
+            size_t done = static_cast<size_t>(n);
+            while (count > 0 && done >= it->iov_len) {
+                done -= it->iov_len;
+                it++;
+                count--;
+            }
+
+            if (count > 0) {
+                it->iov_base = static_cast<char *>(it->iov_base) + done;
+                it->iov_len -= done;
+            }
+        }
+
+        iovCount = 0;
+        poolSize = 0;
+        return true;
+    }
+
+    inline bool Reserve() {
+        return iovCount < IOV_MAX || Flush();
+    }
+
+    bool Copy(const char *data, size_t size) {
+        if (poolSize + size > sizeof(pool) && !Flush()) {
+            return false;
+        }
+
+        char *target = pool + poolSize;
+        memcpy(target, data, size);
+        poolSize += size;
+
+        // Consecutive copies share one slice
+        if (iovCount > 0) {
+            auto &last = iov[iovCount - 1];
+            if (static_cast<char *>(last.iov_base) + last.iov_len == target) {
+                last.iov_len += size;
+                return true;
+            }
+        }
+
+        if (!Reserve()) {
+            return false;
+        }
+
+        // A flush empties the pool, so the copy moves to the front
+        if (poolSize == 0) {
+            memcpy(pool, data, size);
+            poolSize = size;
+            target = pool;
+        }
+
+        iov[iovCount++] = {target, size};
+        return true;
+    }
+
+    bool Put(const char *data, size_t size) {
+        if (size < scatterCopyLimit) {
+            return Copy(data, size);
+        }
+
+        if (!Reserve()) {
+            return false;
+        }
+
+        iov[iovCount++] = {const_cast<char *>(data), size};
+        return true;
+    }
+
+    inline bool Put(StringView view) { return Put(view.begin, view.Size()); }
+
+    bool NewLine(int level) {
+        if (!Copy("\n", 1)) {
+            return false;
+        }
+
+        for (size_t n = static_cast<size_t>(level) * 2; n != 0;) {
+            size_t chunk = std::min(n, sizeof(scatterSpaces) - 1);
+            if (!Put(scatterSpaces, chunk)) {
+                return false;
+            }
+            n -= chunk;
+        }
+
+        return true;
+    }
+
+    bool Value(Element *e, ArenaAllocator &arena, int level) {
+        switch (e->type) {
+        case Element::Type::String:
+            return Copy("\"", 1) && Put(e->GetEscapedString(arena)) &&
+                   Copy("\"", 1);
+        case Element::Type::Number:
+            return Put(e->ref);
+        case Element::Type::Object:
+            if (!Copy("{", 1)) {
+                return false;
+            }
+
+            for (auto it = e->firstChild; it != nullptr; it = it->next) {
+                if (it != e->firstChild && !Copy(",", 1)) {
+                    return false;
+                }
+
+                if (!NewLine(level + 1) || !Copy("\"", 1) ||
+                    !Put(it->GetEscapedString(arena)) || !Copy("\": ", 3)) {
+                    return false;
+                }
+
+                if (!it->firstChild ||
+                    !Value(it->firstChild, arena, level + 1)) {
+                    return false;
+                }
+            }
+
+            // Empty containers still get a blank line, as with Serialize
+            if (!e->firstChild && !Copy("\n", 1)) {
+                return false;
+            }
+
+            return NewLine(level) && Copy("}", 1);
+        case Element::Type::Array:
+            if (!Copy("[", 1)) {
+                return false;
+            }
+
+            for (auto it = e->firstChild; it != nullptr; it = it->next) {
+                if (it != e->firstChild && !Copy(",", 1)) {
+                    return false;
+                }
+
+                if (!NewLine(level + 1) || !Value(it, arena, level + 1)) {
+                    return false;
+                }
+            }
+
+            if (!e->firstChild && !Copy("\n", 1)) {
+                return false;
+            }
+
+            return NewLine(level) && Copy("]", 1);
+        case Element::Type::Null:
+            return Copy("null", 4);
+        case Element::Type::True:
+            return Copy("true", 4);
+        case Element::Type::False:
+            return Copy("false", 5);
+        default:
+            return false;
+        }
+    }
+};
+
+} // namespace
+
+bool SerializeToFd(Element *root, ArenaAllocator &arena, int fd) {
+    // Too large for the stack
+    auto out = std::make_unique<ScatterOut>();
+    out->fd = fd;
+
+    return out->Value(root, arena, 0) && out->Flush();
+}
+
+} // namespace StupidJSON
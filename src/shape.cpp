@@ -0,0 +1,157 @@
+#include "stupid-json/shape.hpp"
+#include "stupid-json/tokenizer.hpp"
+
+namespace StupidJSON {
+
+using namespace Tokenizer;
+
+template <typename F> static size_t SumNodes(const Shape::Node &node, F f) {
+    size_t sum = f(node);
+    for (auto &keys : node.orders) {
+        for (auto &key : keys) {
+            if (key.child) {
+                sum += SumNodes(*key.child, f);
+            }
+        }
+    }
+
+    return sum;
+}
+
+// Whether the quoted string at begin is raw
+static bool StartsWith(const char *begin, const char *end,
+                       const std::string &raw) {
+    return static_cast<size_t>(end - begin) >= raw.size() &&
+           memcmp(begin, raw.data(), raw.size()) == 0;
+}
+
+Shape::Keys *Shape::Node::Select(const char *begin, const char *end) {
+    for (auto &keys : orders) {
+        if (StartsWith(begin, end, keys.front().raw)) {
+            return &keys;
+        }
+    }
+
+    return nullptr;
+}
+
+Shape::Keys *Shape::Node::Switch(const Keys *keys, size_t index,
+                                 const char *begin, const char *end) {
+    for (auto &order : orders) {
+        if (&order == keys || order.size() <= index ||
+            !StartsWith(begin, end, order[index].raw)) {
+            continue;
+        }
+
+        size_t i = 0;
+        while (i < index && order[i].raw == (*keys)[i].raw) {
+            i++;
+        }
+
+        if (i == index) {
+            return &order;
+        }
+    }
+
+    return nullptr;
+}
+
+// Whether raw is key with quotes around it
+static bool SameKey(const std::string &raw, const Element *key) {
+    return raw.size() == key->ref.Size() + 2 &&
+           memcmp(raw.data() + 1, key->ref.begin, key->ref.Size()) == 0;
+}
+
+void Shape::Node::Learn(const Element *object) {
+    auto first = object->firstChild;
+    if (!first) {
+        return;
+    }
+
+    // An order that the object goes on from is extended. Objects that part
+    // from an order somewhere in the middle are variants of it, like records
+    // with an optional key, and get an order of their own while there is
+    // room, so that the two don't replace each other on every record.
+    Keys *keys = nullptr;
+    for (auto &order : orders) {
+        size_t shared = 0;
+        for (auto it = first; it != nullptr && shared < order.size() &&
+                              SameKey(order[shared].raw, it);
+             it = it->next) {
+            shared++;
+        }
+
+        if (shared == order.size()) {
+            keys = &order;
+            break;
+        }
+    }
+
+    if (!keys && orders.size() < maxOrders) {
+        orders.emplace_back();
+        keys = &orders.back();
+    } else if (!keys) {
+        keys = &orders[replace];
+        replace = (replace + 1) % maxOrders;
+    }
+
+    // Keys that are still at the same position are moved over as they are,
+    // so only the ones that changed are copied
+    Keys learned;
+    learned.reserve(object->childCount);
+
+    size_t index = 0;
+    for (auto it = first; it != nullptr; it = it->next, index++) {
+        if (index < keys->size() && SameKey((*keys)[index].raw, it)) {
+            learned.push_back(std::move((*keys)[index]));
+        } else {
+            Key key;
+            key.raw.reserve(it->ref.Size() + 2);
+            key.raw += '\"';
+            key.raw.append(it->ref.begin, it->ref.Size());
+            key.raw += '\"';
+            key.escaped =
+                FindChar(it->ref.begin, it->ref.end, '\\') != it->ref.end;
+            learned.push_back(std::move(key));
+        }
+
+        // Parsing only follows nodes that exist, so the keys of containers
+        // get theirs here
+        auto value = it->firstChild;
+        if (value && (value->type == Element::Type::Object ||
+                      value->type == Element::Type::Array)) {
+            learned.back().Child();
+        }
+    }
+
+    // Counts of the nodes that are dropped stay in the totals
+    for (auto &key : *keys) {
+        if (key.child) {
+            hits += SumNodes(*key.child, [](const Node &n) { return n.hits; });
+            misses +=
+                SumNodes(*key.child, [](const Node &n) { return n.misses; });
+        }
+    }
+
+    *keys = std::move(learned);
+}
+
+Shape::Node *Shape::Key::Child() {
+    if (!child) {
+        child = std::make_unique<Node>();
+    }
+
+    return child.get();
+}
+
+void Shape::Clear() { root = Node(); }
+
+size_t Shape::Hits() const {
+    return SumNodes(root, [](const Node &n) { return n.hits; });
+}
+
+size_t Shape::Misses() const {
+    return SumNodes(root, [](const Node &n) { return n.misses; });
+}
+
+} // namespace StupidJSON
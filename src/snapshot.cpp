@@ -0,0 +1,262 @@
+#include "stupid-json/snapshot.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace StupidJSON {
+
+static const char snapshotMagic[8] = {'S', 'J', 'S', 'N', 'A', 'P', 0, 0};
+static const uint32_t snapshotVersion = 1;
+static const uint32_t snapshotByteOrder = 0x01020304;
+
+namespace {
+
+struct SnapshotBuilder {
+    ArenaAllocator &arena;
+    std::vector<FlatNode> nodes;
+    std::string strings;
+
+    // Keys repeat a lot in record-like documents, so they are only stored once
+    std::unordered_map<std::string_view, uint32_t> keys;
+
+    SnapshotBuilder(ArenaAllocator &_arena) : arena(_arena) {}
+
+    bool AddString(uint32_t index, StringView str, bool intern) {
+        if (strings.size() + str.Size() > UINT32_MAX) {
+            return false;
+        }
+
+        uint32_t offset = static_cast<uint32_t>(strings.size());
+
+        if (intern) {
+            auto res = keys.emplace(str.ToStd(), offset);
+            if (res.second) {
+                strings.append(str.begin, str.Size());
+            } else {
+                offset = res.first->second;
+            }
+        } else {
+            strings.append(str.begin, str.Size());
+        }
+
+        nodes[index].strOffset = offset;
+        nodes[index].strSize = static_cast<uint32_t>(str.Size());
+        return true;
+    }
+
+    // Reserve count consecutive nodes and return the index of the first
+    bool Reserve(size_t count, uint32_t &first) {
+        if (nodes.size() + count > UINT32_MAX) {
+            return false;
+        }
+
+        first = static_cast<uint32_t>(nodes.size());
+        nodes.resize(nodes.size() + count, FlatNode{});
+        return true;
+    }
+
+    bool Fill(uint32_t index, Element *elem) {
+        nodes[index].type = static_cast<uint32_t>(elem->type);
+
+        switch (elem->type) {
+        case Element::Type::String: {
+            auto str = elem->GetString(arena);
+            if (str.begin == nullptr && elem->ref.begin != nullptr) {
+                return false; // Failed to unescape
+            }
+
+            return AddString(index, str, false);
+        }
+
+        case Element::Type::Key: {
+            if (!elem->firstChild) {
+                return false;
+            }
+
+            auto str = elem->GetString(arena);
+            if (str.begin == nullptr && elem->ref.begin != nullptr) {
+                return false;
+            }
+
+            uint32_t value;
+            if (!AddString(index, str, true) || !Reserve(1, value)) {
+                return false;
+            }
+
+            nodes[index].firstChild = value;
+            return Fill(value, elem->firstChild);
+        }
+
+        case Element::Type::Number:
+            return AddString(index, elem->ref, false);
+
+        case Element::Type::Object:
+        case Element::Type::Array: {
+            size_t count = 0;
+            for (auto it = elem->firstChild; it != nullptr; it = it->next) {
+                count++;
+            }
+
+            uint32_t first;
+            if (!Reserve(count, first)) {
+                return false;
+            }
+
+            nodes[index].firstChild = first;
+            nodes[index].childCount = static_cast<uint32_t>(count);
+
+            uint32_t i = first;
+            for (auto it = elem->firstChild; it != nullptr; it = it->next) {
+                if (!Fill(i++, it)) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        case Element::Type::Null:
+        case Element::Type::True:
+        case Element::Type::False:
+            return true;
+
+        default:
+            return false;
+        }
+    }
+};
+
+} // namespace
+
+bool Snapshot::Write(Element *root, ArenaAllocator &arena, std::ostream &s) {
+    SnapshotBuilder builder(arena);
+
+    uint32_t rootIndex;
+    if (!builder.Reserve(1, rootIndex) || !builder.Fill(rootIndex, root)) {
+        return false;
+    }
+
+    Header header;
+    memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+    header.version = snapshotVersion;
+    header.byteOrder = snapshotByteOrder;
+    header.nodeCount = builder.nodes.size();
+    header.stringsSize = builder.strings.size();
+
+    s.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    s.write(reinterpret_cast<const char *>(builder.nodes.data()),
+            builder.nodes.size() * sizeof(FlatNode));
+    s.write(builder.strings.data(), builder.strings.size());
+
+    return s.good();
+}
+
+bool Snapshot::Open(const char *path) {
+    nodes = nullptr;
+    strings = nullptr;
+
+    if (!file.Open(path, MappedFile::Access::Random)) {
+        return false;
+    }
+
+    if (!Load(file.View())) {
+        file.Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool Snapshot::Load(StringView buffer) {
+    nodes = nullptr;
+    strings = nullptr;
+
+    if (buffer.Size() < sizeof(Header) ||
+        reinterpret_cast<uintptr_t>(buffer.begin) % alignof(FlatNode) != 0) {
+        return false;
+    }
+
+    Header header;
+    memcpy(&header, buffer.begin, sizeof(header));
+
+    if (memcmp(header.magic, snapshotMagic, sizeof(header.magic)) != 0 ||
+        header.version != snapshotVersion ||
+        header.byteOrder != snapshotByteOrder) {
+        return false;
+    }
+
+    size_t payload = buffer.Size() - sizeof(Header);
+    if (header.nodeCount == 0 || header.nodeCount > UINT32_MAX ||
+        header.nodeCount > payload / sizeof(FlatNode) ||
+        header.stringsSize != payload - header.nodeCount * sizeof(FlatNode)) {
+        return false;
+    }
+
+    auto table = reinterpret_cast<const FlatNode *>(buffer.begin +
+                                                    sizeof(Header));
+    uint64_t count = header.nodeCount;
+
+    // Children are always stored after their parent, which rules out cycles
+    // and makes a single pass enough to validate every reference
+    for (uint64_t i = 0; i < count; ++i) {
+        const FlatNode &node = table[i];
+
+        switch (static_cast<Element::Type>(node.type)) {
+        case Element::Type::String:
+        case Element::Type::Number:
+            if (uint64_t(node.strOffset) + node.strSize > header.stringsSize) {
+                return false;
+            }
+            break;
+
+        case Element::Type::Key:
+            if (uint64_t(node.strOffset) + node.strSize > header.stringsSize ||
+                node.firstChild <= i || node.firstChild >= count ||
+                table[node.firstChild].type ==
+                    static_cast<uint32_t>(Element::Type::Key)) {
+                return false;
+            }
+            break;
+
+        case Element::Type::Object:
+        case Element::Type::Array: {
+            if (node.childCount == 0) {
+                break;
+            }
+
+            if (node.firstChild <= i ||
+                uint64_t(node.firstChild) + node.childCount > count) {
+                return false;
+            }
+
+            bool isObject = node.type == uint32_t(Element::Type::Object);
+            for (uint32_t c = 0; c < node.childCount; ++c) {
+                bool isKey = table[node.firstChild + c].type ==
+                             uint32_t(Element::Type::Key);
+                if (isKey != isObject) {
+                    return false;
+                }
+            }
+        } break;
+
+        case Element::Type::Null:
+        case Element::Type::True:
+        case Element::Type::False:
+            break;
+
+        default:
+            return false;
+        }
+    }
+
+    if (table[0].type == uint32_t(Element::Type::Key)) {
+        return false;
+    }
+
+    nodes = table;
+    strings = reinterpret_cast<const char *>(table + count);
+    return true;
+}
+
+} // namespace StupidJSON
@@ -0,0 +1,265 @@
+#include "stupid-json/validate.hpp"
+#include "stupid-json/tokenizer.hpp"
+
+namespace StupidJSON {
+
+using namespace Tokenizer;
+
+const char *ValidateResult::Message() const {
+    switch (error) {
+    case ValidateError::None:
+        return "Valid";
+    case ValidateError::UnexpectedEnd:
+        return "End of document reached before end of value";
+    case ValidateError::UnexpectedChar:
+        return "Unexpected char";
+    case ValidateError::InvalidString:
+        return "String not terminated or contains control chars";
+    case ValidateError::InvalidEscape:
+        return "String contains incorrectly escaped characters";
+    case ValidateError::InvalidNumber:
+        return "Malformed number";
+    case ValidateError::InvalidLiteral:
+        return "Invalid token";
+    case ValidateError::TooDeep:
+        return "Containers nested too deep";
+    case ValidateError::TrailingChars:
+        return "Unexpected chars after value";
+    }
+
+    return "Unknown error";
+}
+
+namespace {
+
+struct Validator {
+    const char *begin;
+    const char *end;
+    ValidateError error = ValidateError::None;
+    const char *errorAt = nullptr;
+
+    // Open containers, one bit per level, set for objects
+    uint64_t stack[validateMaxDepth / 64] = {};
+    size_t depth = 0;
+
+    const char *Fail(ValidateError e, const char *at) {
+        error = e;
+        errorAt = at;
+        return nullptr;
+    }
+
+    inline bool Push(bool isObject) {
+        if (depth == validateMaxDepth) {
+            return false;
+        }
+
+        uint64_t bit = uint64_t(1) << (depth % 64);
+        if (isObject) {
+            stack[depth / 64] |= bit;
+        } else {
+            stack[depth / 64] &= ~bit;
+        }
+
+        depth++;
+        return true;
+    }
+
+    inline bool TopIsObject() const {
+        size_t top = depth - 1;
+        return (stack[top / 64] >> (top % 64)) & 1;
+    }
+
+    // It should point at the opening quote, returns the end of the string
+    const char *String(const char *it) {
+        auto quote = it++;
+
+        while (true) {
+            // Skip over plain chars 8 at a time
+            while (end - it >= 8) {
+                uint64_t w = LoadWord(it);
+                if (SwarHasByte(w, '\"') | SwarHasByte(w, '\\') |
+                    SwarHasLess(w, 0x20)) {
+                    break;
+                }
+
+                it += 8;
+            }
+
+            if (it == end) {
+                return Fail(ValidateError::InvalidString, quote);
+            }
+
+            char c = *it;
+            if (c == '\"') {
+                return it + 1;
+            }
+
+            if (c == '\\') {
+                auto escEnd = ScanEscape(it, end);
+                if (!escEnd) {
+                    return Fail(ValidateError::InvalidEscape, it);
+                }
+
+                it = escEnd;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                return Fail(ValidateError::InvalidString, it);
+            } else {
+                it++;
+            }
+        }
+    }
+
+    // A key, the colon after it and any whitespace before the value
+    const char *Member(const char *it) {
+        if (it == end) {
+            return Fail(ValidateError::UnexpectedEnd, it);
+        }
+
+        if (*it != '\"') {
+            return Fail(ValidateError::UnexpectedChar, it);
+        }
+
+        it = String(it);
+        if (!it) {
+            return nullptr;
+        }
+
+        it = FwdSpaces(it, end);
+        if (it == end) {
+            return Fail(ValidateError::UnexpectedEnd, it);
+        }
+
+        if (*it != ':') {
+            return Fail(ValidateError::UnexpectedChar, it);
+        }
+
+        return FwdSpaces(it + 1, end);
+    }
+
+    const char *Literal(const char *it, StringView token) {
+        if (static_cast<size_t>(end - it) < token.Size() ||
+            memcmp(it, token.begin, token.Size()) != 0) {
+            return Fail(ValidateError::InvalidLiteral, it);
+        }
+
+        return it + token.Size();
+    }
+
+    // Iterative, so that deep nesting costs bits instead of stack frames
+    const char *Run() {
+        const char *it = FwdSpaces(begin, end);
+
+        while (true) {
+            // A value is expected at it
+            if (it == end) {
+                return Fail(ValidateError::UnexpectedEnd, it);
+            }
+
+            switch (*it) {
+            case '{':
+            case '[': {
+                bool isObject = *it == '{';
+                if (!Push(isObject)) {
+                    return Fail(ValidateError::TooDeep, it);
+                }
+
+                it = FwdSpaces(it + 1, end);
+                if (it != end && *it == (isObject ? '}' : ']')) {
+                    depth--;
+                    it++;
+                    break;
+                }
+
+                if (isObject && !(it = Member(it))) {
+                    return nullptr;
+                }
+                continue;
+            }
+
+            case '\"':
+                it = String(it);
+                break;
+
+            case '0':
+            case '1':
+            case '2':
+            case '3':
+            case '4':
+            case '5':
+            case '6':
+            case '7':
+            case '8':
+            case '9':
+            case '-': {
+                auto numEnd = ScanNumber(it, end);
+                it = numEnd ? numEnd : Fail(ValidateError::InvalidNumber, it);
+            } break;
+
+            case 't':
+                it = Literal(it, "true");
+                break;
+
+            case 'f':
+                it = Literal(it, "false");
+                break;
+
+            case 'n':
+                it = Literal(it, "null");
+                break;
+
+            default:
+                return Fail(ValidateError::UnexpectedChar, it);
+            }
+
+            if (!it) {
+                return nullptr;
+            }
+
+            // A value is complete, close containers until another value is
+            // expected
+            while (true) {
+                it = FwdSpaces(it, end);
+
+                if (depth == 0) {
+                    return it == end ? it
+                                     : Fail(ValidateError::TrailingChars, it);
+                }
+
+                if (it == end) {
+                    return Fail(ValidateError::UnexpectedEnd, it);
+                }
+
+                bool isObject = TopIsObject();
+
+                if (*it == ',') {
+                    it = FwdSpaces(it + 1, end);
+                    if (isObject && !(it = Member(it))) {
+                        return nullptr;
+                    }
+                    break;
+                }
+
+                if (*it != (isObject ? '}' : ']')) {
+                    return Fail(ValidateError::UnexpectedChar, it);
+                }
+
+                depth--;
+                it++;
+            }
+        }
+    }
+};
+
+} // namespace
+
+ValidateResult Validate(StringView body) {
+    Validator v{body.begin, body.end};
+
+    if (!v.Run()) {
+        return {v.error, static_cast<size_t>(v.errorAt - body.begin)};
+    }
+
+    return {ValidateError::None, body.Size()};
+}
+
+} // namespace StupidJSON
@@ -0,0 +1,270 @@
+#include "stupid-json/writer.hpp"
+#include "stupid-json/tokenizer.hpp"
+
+namespace StupidJSON {
+
+using namespace Tokenizer;
+
+Writer::Writer(std::ostream &s, size_t _flushSize)
+    : sink(&s), flushSize(_flushSize) {}
+
+bool Writer::Fail(const char *msg) {
+    if (!error) {
+        error = msg;
+    }
+
+    return false;
+}
+
+bool Writer::BeginValue() {
+    if (error) {
+        return false;
+    }
+
+    if (!stack.empty() && stack.back()) {
+        if (!afterKey) {
+            return Fail("Value in object without a key");
+        }
+
+        afterKey = false;
+        return true;
+    }
+
+    if (!first) {
+        Put(stack.empty() ? '\n' : ',');
+    }
+
+    first = false;
+    return true;
+}
+
+void Writer::Put(char c) { buffer.push_back(c); }
+
+void Writer::Put(StringView str) { buffer.append(str.begin, str.Size()); }
+
+void Writer::PutEscaped(StringView str) {
+    size_t size = EscapedSize(str.begin, str.end);
+    size_t offset = buffer.size();
+
+    buffer.resize(offset + size + 2);
+    buffer[offset] = '\"';
+    EscapeChars(str.begin, str.end, &buffer[offset + 1]);
+    buffer[offset + size + 1] = '\"';
+}
+
+bool Writer::MaybeFlush() {
+    if (sink && buffer.size() >= flushSize) {
+        return Flush();
+    }
+
+    return true;
+}
+
+bool Writer::BeginObject() {
+    if (!BeginValue()) {
+        return false;
+    }
+
+    Put('{');
+    stack.push_back(true);
+    first = true;
+    return true;
+}
+
+bool Writer::EndObject() {
+    if (error) {
+        return false;
+    }
+
+    if (stack.empty() || !stack.back() || afterKey) {
+        return Fail("Unexpected end of object");
+    }
+
+    Put('}');
+    stack.pop_back();
+    first = false;
+    return MaybeFlush();
+}
+
+bool Writer::BeginArray() {
+    if (!BeginValue()) {
+        return false;
+    }
+
+    Put('[');
+    stack.push_back(false);
+    first = true;
+    return true;
+}
+
+bool Writer::EndArray() {
+    if (error) {
+        return false;
+    }
+
+    if (stack.empty() || stack.back()) {
+        return Fail("Unexpected end of array");
+    }
+
+    Put(']');
+    stack.pop_back();
+    first = false;
+    return MaybeFlush();
+}
+
+bool Writer::BeginKey() {
+    if (error) {
+        return false;
+    }
+
+    if (stack.empty() || !stack.back() || afterKey) {
+        return Fail("Key outside of object");
+    }
+
+    if (!first) {
+        Put(',');
+    }
+
+    first = false;
+    afterKey = true;
+    return true;
+}
+
+bool Writer::Key(StringView name) {
+    if (!BeginKey()) {
+        return false;
+    }
+
+    PutEscaped(name);
+    Put(':');
+    return true;
+}
+
+bool Writer::String(StringView str) {
+    if (!BeginValue()) {
+        return false;
+    }
+
+    PutEscaped(str);
+    return MaybeFlush();
+}
+
+bool Writer::Bool(bool val) {
+    if (!BeginValue()) {
+        return false;
+    }
+
+    Put(val ? "true" : "false");
+    return MaybeFlush();
+}
+
+bool Writer::Null() {
+    if (!BeginValue()) {
+        return false;
+    }
+
+    Put("null");
+    return MaybeFlush();
+}
+
+bool Writer::Value(Element *elem, ArenaAllocator &arena) {
+    switch (elem->type) {
+    case Element::Type::String:
+        if (!BeginValue()) {
+            return false;
+        }
+
+        // The escaped form is usually the source text, so it is copied as is
+        Put('\"');
+        Put(elem->GetEscapedString(arena));
+        Put('\"');
+        return MaybeFlush();
+
+    case Element::Type::Number:
+        if (!BeginValue()) {
+            return false;
+        }
+
+        Put(elem->ref);
+        return MaybeFlush();
+
+    case Element::Type::Object:
+        if (!BeginObject()) {
+            return false;
+        }
+
+        for (auto it = elem->firstChild; it != nullptr; it = it->next) {
+            if (!it->firstChild) {
+                return Fail("Key without a value");
+            }
+
+            if (!BeginKey()) {
+                return false;
+            }
+
+            Put('\"');
+            Put(it->GetEscapedString(arena));
+            Put("\":");
+
+            if (!Value(it->firstChild, arena)) {
+                return false;
+            }
+        }
+
+        return EndObject();
+
+    case Element::Type::Array:
+        if (!BeginArray()) {
+            return false;
+        }
+
+        for (auto it = elem->firstChild; it != nullptr; it = it->next) {
+            if (!Value(it, arena)) {
+                return false;
+            }
+        }
+
+        return EndArray();
+
+    case Element::Type::Null:
+        return Null();
+
+    case Element::Type::True:
+        return Bool(true);
+
+    case Element::Type::False:
+        return Bool(false);
+
+    default:
+        return Fail("Invalid element");
+    }
+}
+
+bool Writer::Flush() {
+    if (error) {
+        return false;
+    }
+
+    if (!sink || buffer.empty()) {
+        return true;
+    }
+
+    sink->write(buffer.data(), buffer.size());
+    buffer.clear();
+
+    if (!sink->good()) {
+        return Fail("Failed to write to stream");
+    }
+
+    return true;
+}
+
+void Writer::Reset() {
+    buffer.clear();
+    stack.clear();
+    first = true;
+    afterKey = false;
+    error = nullptr;
+}
+
+} // namespace StupidJSON
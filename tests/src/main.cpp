@@ -1,9 +1,30 @@
 #include "stupid-json/arena.hpp"
+#include "stupid-json/binary.hpp"
+#include "stupid-json/bind.hpp"
+#include "stupid-json/cache.hpp"
+#include "stupid-json/containers.hpp"
+#include "stupid-json/document.hpp"
+#include "stupid-json/embedded.hpp"
+#include "stupid-json/format.hpp"
+#include "stupid-json/hash.hpp"
+#include "stupid-json/incremental.hpp"
+#include "stupid-json/parallel.hpp"
+#include "stupid-json/projection.hpp"
+#include "stupid-json/query.hpp"
+#include "stupid-json/sax.hpp"
+#include "stupid-json/scatter.hpp"
+#include "stupid-json/shape.hpp"
+#include "stupid-json/snapshot.hpp"
+#include "stupid-json/tokenizer.hpp"
+#include "stupid-json/validate.hpp"
+#include "stupid-json/writer.hpp"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include <cmath>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <thread>
 
 using namespace StupidJSON;
 
@@ -21,6 +42,80 @@ static std::string ReadFile(std::string_view name) {
     return body;
 }
 
+struct BindUser {
+    uint64_t id = 0;
+    std::string screen_name;
+};
+
+struct BindStatus {
+    uint64_t id = 0;
+    StringView text;
+    int retweet_count = -1;
+    bool favorited = true;
+    BindUser user;
+};
+
+struct BindTwitter {
+    std::vector<BindStatus> statuses;
+};
+
+struct BindGeometry {
+    std::string type;
+    std::vector<std::vector<std::vector<double>>> coordinates;
+};
+
+struct BindFeature {
+    BindGeometry geometry;
+};
+
+struct BindCanada {
+    std::vector<BindFeature> features;
+};
+
+STUPID_JSON_BIND(BindUser, STUPID_JSON_FIELD(BindUser, id),
+                 STUPID_JSON_FIELD(BindUser, screen_name))
+STUPID_JSON_BIND(BindStatus, STUPID_JSON_FIELD(BindStatus, id),
+                 STUPID_JSON_FIELD(BindStatus, text),
+                 STUPID_JSON_FIELD(BindStatus, retweet_count),
+                 STUPID_JSON_FIELD(BindStatus, favorited),
+                 STUPID_JSON_FIELD(BindStatus, user))
+STUPID_JSON_BIND(BindTwitter, STUPID_JSON_FIELD(BindTwitter, statuses))
+STUPID_JSON_BIND(BindGeometry, STUPID_JSON_FIELD(BindGeometry, type),
+                 STUPID_JSON_FIELD(BindGeometry, coordinates))
+STUPID_JSON_BIND(BindFeature, STUPID_JSON_FIELD(BindFeature, geometry))
+STUPID_JSON_BIND(BindCanada, STUPID_JSON_FIELD(BindCanada, features))
+
+static bool SameTree(Element *a, FlatElement b, ArenaAllocator &arena) {
+    if (a->type != b.Type()) {
+        return false;
+    }
+
+    switch (a->type) {
+    case Element::Type::String:
+        return a->GetString(arena) == b.GetString();
+    case Element::Type::Number: {
+        double x, y;
+        return a->GetFloatingPoint(x) && b.GetFloatingPoint(y) && x == y;
+    }
+    case Element::Type::Array: {
+        bool same = a->childCount == b.ChildCount();
+        a->IterateArray([&](auto index, Element *child) {
+            same = same && SameTree(child, b.GetArrayIndex(index), arena);
+        });
+        return same;
+    }
+    case Element::Type::Object: {
+        bool same = a->childCount == b.ChildCount();
+        a->IterateObject(arena, [&](auto key, Element *child) {
+            same = same && SameTree(child, b.FindChildElement(key), arena);
+        });
+        return same;
+    }
+    default:
+        return true;
+    }
+}
+
 TEST(Basic, Class) {
     EXPECT_EQ(sizeof(Element), 56);
     EXPECT_TRUE(std::is_move_constructible<Element>::value);
@@ -165,6 +260,1245 @@ TEST(Parsing, HugeDoc) {
     });
 }
 
+TEST(Parsing, NumberGrammar) {
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+
+    for (auto num : {"0", "-0", "12", "-12.5", "0.25", "1e5", "1E+5", "2.5e-7",
+                     "-0.0e0", "12345678901234567890123"}) {
+        EXPECT_TRUE(root->ParseBody(num, arena)) << num;
+        EXPECT_EQ(root->type, Element::Type::Number);
+        EXPECT_EQ(root->ref, num);
+        EXPECT_TRUE(Validate(num)) << num;
+    }
+
+    for (auto num : {"-", "01", "-01", "1.", ".5", "1e", "1e+", "-a"}) {
+        EXPECT_FALSE(root->ParseBody(num, arena) &&
+                     root->ref.Size() == strlen(num))
+            << num;
+        EXPECT_FALSE(Validate(num)) << num;
+    }
+
+    double d;
+    EXPECT_TRUE(root->ParseBody("[2.5e-7]", arena));
+    EXPECT_TRUE(root->GetArrayIndex(0)->GetFloatingPoint(d));
+    EXPECT_EQ(d, 2.5e-7);
+
+    // Negative zero only fits in a double
+    EXPECT_TRUE(root->ParseBody("-0", arena));
+    EXPECT_TRUE(root->DecodeNumber());
+    EXPECT_EQ(root->decoded, Element::Decoded::FloatingPoint);
+    EXPECT_TRUE(root->GetFloatingPoint(d));
+    EXPECT_TRUE(std::signbit(d));
+
+    // Integers are accumulated during the scan, 8 digits at a time
+    struct {
+        const char *text;
+        bool isInteger;
+        int64_t value;
+    } cases[] = {
+        {"0", true, 0},
+        {"-0", false, 0},
+        {"-7", true, -7},
+        {"1234567890123", true, 1234567890123},
+        {"9223372036854775807", true, INT64_MAX},
+        {"-9223372036854775808", true, INT64_MIN},
+        {"9223372036854775808", false, 0},
+        {"99999999999999999999", false, 0},
+        {"1.0", false, 0},
+        {"1e3", false, 0},
+    };
+
+    for (auto &c : cases) {
+        Tokenizer::NumberScan scan;
+        auto end = c.text + strlen(c.text);
+        EXPECT_EQ(Tokenizer::ScanNumber(c.text, end, &scan), end);
+        EXPECT_EQ(scan.isInteger, c.isInteger) << c.text;
+        if (c.isInteger) {
+            EXPECT_EQ(scan.integer, c.value) << c.text;
+        }
+    }
+
+    ParseOptions options;
+    options.decodeNumbers = true;
+    EXPECT_TRUE(root->ParseBody("[-9223372036854775808, 1e2, 3]", arena,
+                                options));
+
+    int64_t i;
+    EXPECT_TRUE(root->GetArrayIndex(0)->GetInteger(i));
+    EXPECT_EQ(i, INT64_MIN);
+    EXPECT_EQ(root->GetArrayIndex(1)->decoded,
+              Element::Decoded::FloatingPoint);
+    EXPECT_EQ(root->GetArrayIndex(1)->floatValue, 100);
+    EXPECT_FALSE(root->ParseBody("[1, 01]", arena, options));
+
+    EXPECT_TRUE(root->ParseBody("[-0]", arena, options));
+    EXPECT_EQ(root->GetArrayIndex(0)->decoded,
+              Element::Decoded::FloatingPoint);
+    EXPECT_TRUE(std::signbit(root->GetArrayIndex(0)->floatValue));
+}
+
+TEST(Parsing, NumberArrays) {
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+    EXPECT_TRUE(root->ParseBody("[[1, -2], [3, 4.5], [5, 6]]", arena));
+
+    int64_t ints[2];
+    EXPECT_TRUE(root->GetArrayIndex(0)->GetNumberArray(ints, 2));
+    EXPECT_EQ(ints[1], -2);
+    EXPECT_FALSE(root->GetArrayIndex(0)->GetNumberArray(ints, 1));
+
+    uint8_t bytes[2];
+    EXPECT_FALSE(root->GetArrayIndex(0)->GetNumberArray(bytes, 2));
+
+    // Only whole integers are read as integers
+    EXPECT_FALSE(root->GetArrayIndex(1)->GetNumberArray(ints, 2));
+    int64_t whole[6];
+    EXPECT_FALSE(root->GetNumberTuples(whole, 2, 2, 3));
+    for (auto body : {"[1.5]", "[1e3]", "[2.0]"}) {
+        EXPECT_TRUE(root->ParseBody(body, arena));
+        EXPECT_FALSE(root->GetNumberArray(ints, 2)) << body;
+        EXPECT_TRUE(root->Freeze(arena));
+        EXPECT_FALSE(root->GetNumberArray(ints, 2)) << body;
+    }
+    EXPECT_TRUE(root->ParseBody("[[1, -2], [3, 4.5], [5, 6]]", arena));
+
+    // Padded to a stride of 3
+    double tuples[9] = {};
+    EXPECT_TRUE(root->GetNumberTuples(tuples, 2, 3, 3));
+    EXPECT_EQ(tuples[3], 3);
+    EXPECT_EQ(tuples[4], 4.5);
+    EXPECT_EQ(tuples[5], 0);
+    EXPECT_EQ(tuples[7], 6);
+
+    EXPECT_FALSE(root->GetNumberTuples(tuples, 3, 3, 3));
+    EXPECT_FALSE(root->GetNumberTuples(tuples, 2, 3, 2));
+    EXPECT_TRUE(root->ParseBody("[[1, 2], [3, \"4\"]]", arena));
+    EXPECT_FALSE(root->GetNumberTuples(tuples, 2, 2, 4));
+
+    EXPECT_TRUE(root->ParseBody("[-0, 1]", arena));
+    EXPECT_TRUE(root->Freeze(arena));
+    EXPECT_TRUE(root->GetNumberArray(tuples, 2));
+    EXPECT_TRUE(std::signbit(tuples[0]));
+}
+
+TEST(Parsing, DecodeNumbers) {
+    ParseOptions options;
+    options.decodeNumbers = true;
+
+    ArenaAllocator arena;
+    auto plain = arena.CreateElement();
+    auto decoded = arena.CreateElement();
+    EXPECT_TRUE(
+        plain->ParseBody({canadaBody.data(), canadaBody.size()}, arena));
+    EXPECT_TRUE(decoded->ParseBody({canadaBody.data(), canadaBody.size()},
+                                   arena, options));
+
+    auto rings = [&](Element *root) {
+        return root->FindChildElement("features", arena)
+            ->GetArrayIndex(0)
+            ->FindChildElement("geometry", arena)
+            ->FindChildElement("coordinates", arena);
+    };
+
+    size_t points = 0;
+    std::vector<double> a, b;
+    auto ring = rings(plain)->firstChild;
+    auto decodedRing = rings(decoded)->firstChild;
+
+    for (; ring && decodedRing;
+         ring = ring->next, decodedRing = decodedRing->next) {
+        auto first = decodedRing->firstChild->firstChild;
+        EXPECT_EQ(first->decoded, Element::Decoded::FloatingPoint);
+
+        a.resize(ring->childCount * 2);
+        b.resize(ring->childCount * 2);
+        EXPECT_TRUE(ring->GetNumberTuples(a.data(), 2, 2, ring->childCount));
+        EXPECT_TRUE(decodedRing->GetNumberTuples(b.data(), 2, 2,
+                                                 decodedRing->childCount));
+        EXPECT_EQ(a, b);
+
+        // Same as reading one number at a time
+        double x, y;
+        ring->GetArrayIndex(1)->GetArrayIndex(0)->GetFloatingPoint(x);
+        ring->GetArrayIndex(1)->GetArrayIndex(1)->GetFloatingPoint(y);
+        EXPECT_EQ(a[2], x);
+        EXPECT_EQ(a[3], y);
+
+        points += ring->childCount;
+    }
+
+    EXPECT_EQ(points, 55563);
+
+    // Object members are left alone, and integers that don't fit in 64 bits
+    // are decoded as floating point
+    EXPECT_TRUE(decoded->ParseBody(
+        "{\"a\": 1, \"b\": [1, 123456789012345678901234567890]}", arena,
+        options));
+    EXPECT_EQ(decoded->FindChildElement("a", arena)->decoded,
+              Element::Decoded::None);
+
+    auto big = decoded->FindChildElement("b", arena);
+    EXPECT_EQ(big->GetArrayIndex(0)->decoded, Element::Decoded::Integer);
+    EXPECT_EQ(big->GetArrayIndex(1)->decoded, Element::Decoded::FloatingPoint);
+
+    int64_t i;
+    double d;
+    EXPECT_FALSE(big->GetArrayIndex(1)->GetInteger(i));
+    EXPECT_TRUE(big->GetArrayIndex(1)->GetFloatingPoint(d));
+    EXPECT_EQ(d, 123456789012345678901234567890.0);
+}
+
+TEST(Query, Compile) {
+    Query q;
+    EXPECT_TRUE(q.Compile(""));
+    EXPECT_EQ(q.Depth(), 0);
+    EXPECT_TRUE(q.Compile("/features/0/geometry"));
+    EXPECT_EQ(q.Depth(), 3);
+    EXPECT_TRUE(q.Compile("/a~1b/m~0n/*"));
+    EXPECT_FALSE(q.Compile("features"));
+    EXPECT_FALSE(q.Compile("/a~2"));
+    EXPECT_FALSE(q.Compile("/a~"));
+}
+
+TEST(Query, Pointer) {
+    ArenaAllocator arena;
+    Query q;
+    EXPECT_TRUE(q.Compile("/features/0/geometry/coordinates"));
+
+    std::vector<Element *> hits;
+    EXPECT_TRUE(
+        q.Evaluate({canadaBody.data(), canadaBody.size()}, arena, hits));
+    EXPECT_EQ(hits.size(), 1);
+    EXPECT_EQ(hits[0]->type, Element::Type::Array);
+    EXPECT_EQ(hits[0]->childCount, 480);
+
+    auto body = "{\"a/b\": {\"m~n\": 1, \"\\u0078\": [5, 6]}}";
+    EXPECT_TRUE(q.Compile("/a~1b/m~0n"));
+    hits.clear();
+    EXPECT_TRUE(q.Evaluate(body, arena, hits));
+    EXPECT_EQ(hits.size(), 1);
+    EXPECT_EQ(hits[0]->ref, "1");
+
+    EXPECT_TRUE(q.Compile("/a~1b/x/1"));
+    hits.clear();
+    EXPECT_TRUE(q.Evaluate(body, arena, hits));
+    EXPECT_EQ(hits.size(), 1);
+    EXPECT_EQ(hits[0]->ref, "6");
+
+    EXPECT_TRUE(q.Compile("/a~1b/missing"));
+    hits.clear();
+    EXPECT_TRUE(q.Evaluate(body, arena, hits));
+    EXPECT_TRUE(hits.empty());
+}
+
+TEST(Query, Wildcard) {
+    ArenaAllocator arena;
+    Query q;
+    EXPECT_TRUE(q.Compile("/statuses/*/user/id"));
+
+    std::vector<Element *> rawHits;
+    EXPECT_TRUE(
+        q.Evaluate({twitterBody.data(), twitterBody.size()}, arena, rawHits));
+    EXPECT_EQ(rawHits.size(), 100);
+
+    auto root = arena.CreateElement();
+    EXPECT_TRUE(
+        root->ParseBody({twitterBody.data(), twitterBody.size()}, arena));
+
+    std::vector<Element *> treeHits;
+    q.Evaluate(root, arena, treeHits);
+    EXPECT_EQ(rawHits.size(), treeHits.size());
+
+    for (size_t i = 0; i < rawHits.size() && i < treeHits.size(); ++i) {
+        EXPECT_EQ(rawHits[i]->type, Element::Type::Number);
+        EXPECT_EQ(rawHits[i]->ref, treeHits[i]->ref);
+    }
+}
+
+TEST(Projection, Simple) {
+    ArenaAllocator arena;
+    Projection proj;
+    EXPECT_TRUE(proj.Add("/a/b"));
+    EXPECT_TRUE(proj.Add("/c"));
+    EXPECT_TRUE(proj.Add("/d~1e"));
+    EXPECT_FALSE(proj.Add("f"));
+    EXPECT_FALSE(proj.Add("/g~2"));
+
+    ParseOptions options;
+    options.projection = &proj;
+
+    auto body = "{\"skip\": {\"x\": [1, \"}]\", {}]}, \"a\": {\"b\": 1, "
+                "\"z\": [2]}, \"c\": {\"k\": [true, null]}, \"d/e\": \"s\", "
+                "\"\\u0063\": 3, \"n\": -1.5}";
+
+    auto root = arena.CreateElement();
+    EXPECT_TRUE(root->ParseBody(body, arena, options));
+    EXPECT_EQ(root->childCount, 4);
+
+    std::ostringstream s;
+    root->Serialize(arena, s);
+
+    std::ostringstream expected;
+    auto ref = arena.CreateElement();
+    EXPECT_TRUE(ref->ParseBody("{\"a\": {\"b\": 1}, \"c\": {\"k\": [true, "
+                               "null]}, \"d/e\": \"s\", \"\\u0063\": 3}",
+                               arena));
+    ref->Serialize(arena, expected);
+    EXPECT_EQ(s.str(), expected.str());
+
+    // Skipped members are not validated, but the object still has to end
+    EXPECT_TRUE(root->ParseBody("{\"x\": [{\"y\": }], \"c\": 1}", arena,
+                                options));
+    EXPECT_FALSE(root->ParseBody("{\"x\": [1, 2", arena, options));
+    EXPECT_FALSE(root->ParseBody("{\"x\" 1}", arena, options));
+
+    // An empty pointer keeps everything
+    EXPECT_TRUE(proj.Add(""));
+    EXPECT_TRUE(root->ParseBody(body, arena, options));
+    EXPECT_EQ(root->childCount, 6);
+}
+
+TEST(Projection, Overlap) {
+    ArenaAllocator arena;
+    auto serialize = [&](StringView body, const Projection *proj) {
+        ParseOptions options;
+        options.projection = proj;
+        auto root = arena.CreateElement();
+        EXPECT_TRUE(root->ParseBody(body, arena, options));
+
+        std::ostringstream s;
+        root->Serialize(arena, s);
+        return s.str();
+    };
+
+    auto body = "{\"a\": {\"x\": 1, \"y\": 2, \"z\": 3}, \"b\": {\"x\": 4, "
+                "\"y\": 5}, \"c\": 6}";
+    auto expected = serialize("{\"a\": {\"x\": 1, \"y\": 2}, \"b\": "
+                              "{\"y\": 5}, \"c\": 6}",
+                              nullptr);
+
+    // The projection is the union of its paths, whichever is added first
+    for (int i = 0; i < 2; ++i) {
+        Projection proj;
+        EXPECT_TRUE(proj.Add(i ? "/*/y" : "/a/x"));
+        EXPECT_TRUE(proj.Add(i ? "/a/x" : "/*/y"));
+        EXPECT_TRUE(proj.Add("/c"));
+        EXPECT_EQ(serialize(body, &proj), expected) << i;
+    }
+
+    // A wildcard that keeps everything covers the exact paths beside it
+    Projection proj;
+    EXPECT_TRUE(proj.Add("/a/x"));
+    EXPECT_TRUE(proj.Add("/*"));
+    EXPECT_EQ(serialize(body, &proj), serialize(body, nullptr));
+}
+
+TEST(Projection, Twitter) {
+    Projection proj;
+    EXPECT_TRUE(proj.Add("/statuses/id"));
+    EXPECT_TRUE(proj.Add("/statuses/user/screen_name"));
+    EXPECT_TRUE(proj.Add("/statuses/entities/*/indices"));
+
+    ParseOptions options;
+    options.projection = &proj;
+
+    ArenaAllocator full, projected;
+    auto root = full.CreateElement();
+    EXPECT_TRUE(
+        root->ParseBody({twitterBody.data(), twitterBody.size()}, full));
+
+    auto proot = projected.CreateElement();
+    EXPECT_TRUE(proot->ParseBody({twitterBody.data(), twitterBody.size()},
+                                 projected, options));
+
+    EXPECT_EQ(proot->childCount, 1);
+    auto statuses = root->FindChildElement("statuses", full);
+    auto pstatuses = proot->FindChildElement("statuses", projected);
+    EXPECT_TRUE(pstatuses);
+    EXPECT_EQ(pstatuses->childCount, statuses->childCount);
+
+    for (uint32_t i = 0; i < statuses->childCount; ++i) {
+        auto status = statuses->GetArrayIndex(i);
+        auto pstatus = pstatuses->GetArrayIndex(i);
+        EXPECT_EQ(pstatus->childCount, 3);
+
+        EXPECT_EQ(pstatus->FindChildElement("id", projected)->ref,
+                  status->FindChildElement("id", full)->ref);
+
+        auto user = pstatus->FindChildElement("user", projected);
+        EXPECT_EQ(user->childCount, 1);
+        EXPECT_EQ(user->FindChildElement("screen_name", projected)
+                      ->GetString(projected),
+                  status->FindChildElement("user", full)
+                      ->FindChildElement("screen_name", full)
+                      ->GetString(full));
+
+        auto entities = pstatus->FindChildElement("entities", projected);
+        entities->IterateObject(projected, [&](auto, Element *entity) {
+            EXPECT_EQ(entity->type, Element::Type::Array);
+            entity->IterateArray([&](size_t, Element *item) {
+                EXPECT_EQ(item->childCount, 1);
+                EXPECT_TRUE(item->FindChildElement("indices", projected));
+            });
+        });
+    }
+}
+
+TEST(Writer, Simple) {
+    Writer w;
+    EXPECT_TRUE(w.BeginObject());
+    EXPECT_TRUE(w.Key("name"));
+    EXPECT_TRUE(w.String("a\"b\\c\n\x01"));
+    EXPECT_TRUE(w.Key("list"));
+    EXPECT_TRUE(w.BeginArray());
+    EXPECT_TRUE(w.Number(1));
+    EXPECT_TRUE(w.Number(-2.5));
+    EXPECT_TRUE(w.Number(uint64_t(18446744073709551615ull)));
+    EXPECT_TRUE(w.Bool(true));
+    EXPECT_TRUE(w.Null());
+    EXPECT_TRUE(w.BeginObject());
+    EXPECT_TRUE(w.EndObject());
+    EXPECT_TRUE(w.EndArray());
+    EXPECT_FALSE(w.Complete());
+    EXPECT_TRUE(w.EndObject());
+    EXPECT_TRUE(w.Complete());
+
+    EXPECT_EQ(w.View(), "{\"name\":\"a\\\"b\\\\c\\n\\u0001\",\"list\":[1,-2.5,"
+                        "18446744073709551615,true,null,{}]}");
+
+    // The output parses back to the same strings
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+    EXPECT_TRUE(root->ParseBody(w.View(), arena));
+    EXPECT_EQ(root->FindChildElement("name", arena)->GetString(arena),
+              "a\"b\\c\n\x01");
+
+    // Elements escape strings the same way
+    auto str = arena.CreateElement();
+    str->SetString("a\"b\\c\n\x01");
+    EXPECT_EQ(str->GetEscapedString(arena), "a\\\"b\\\\c\\n\\u0001");
+
+    w.Reset();
+    EXPECT_TRUE(w.Number(1));
+    EXPECT_TRUE(w.Number(2));
+    EXPECT_EQ(w.View(), "1\n2");
+
+    w.Reset();
+    EXPECT_TRUE(w.BeginObject());
+    EXPECT_FALSE(w.Number(1));
+    EXPECT_TRUE(w.Error());
+    EXPECT_FALSE(w.Key("a"));
+
+    w.Reset();
+    EXPECT_FALSE(w.Key("a"));
+    w.Reset();
+    EXPECT_TRUE(w.BeginArray());
+    EXPECT_FALSE(w.EndObject());
+    w.Reset();
+    EXPECT_FALSE(w.Number(std::numeric_limits<double>::infinity()));
+}
+
+TEST(Writer, Stream) {
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+    EXPECT_TRUE(
+        root->ParseBody({twitterBody.data(), twitterBody.size()}, arena));
+
+    std::ostringstream out;
+    Writer w(out, 4096);
+    EXPECT_TRUE(w.Value(root, arena));
+    EXPECT_TRUE(w.Complete());
+    EXPECT_LT(w.View().Size(), 4096);
+    EXPECT_TRUE(w.Flush());
+    EXPECT_TRUE(w.View().Empty());
+
+    std::string compact = out.str();
+    EXPECT_LT(compact.size(), twitterBody.size());
+
+    auto copy = arena.CreateElement();
+    EXPECT_TRUE(copy->ParseBody({compact.data(), compact.size()}, arena));
+
+    std::ostringstream a, b;
+    root->Serialize(arena, a);
+    copy->Serialize(arena, b);
+    EXPECT_EQ(a.str(), b.str());
+}
+
+struct SaxCounter : SaxHandler {
+    size_t objects = 0, keys = 0, members = 0, arrays = 0, items = 0;
+    size_t strings = 0, numbers = 0, literals = 0;
+    int depth = 0, maxDepth = 0;
+
+    bool StartObject() {
+        maxDepth = std::max(maxDepth, ++depth);
+        return true;
+    }
+    bool Key(StringView) {
+        keys++;
+        return true;
+    }
+    bool EndObject(size_t count) {
+        depth--;
+        objects++;
+        members += count;
+        return true;
+    }
+    bool StartArray() {
+        maxDepth = std::max(maxDepth, ++depth);
+        return true;
+    }
+    bool EndArray(size_t count) {
+        depth--;
+        arrays++;
+        items += count;
+        return true;
+    }
+    bool String(StringView) {
+        strings++;
+        return true;
+    }
+    bool Number(StringView) {
+        numbers++;
+        return true;
+    }
+    bool Bool(bool) {
+        literals++;
+        return true;
+    }
+    bool Null() {
+        literals++;
+        return true;
+    }
+};
+
+static void CountTree(Element *elem, SaxCounter &c) {
+    switch (elem->type) {
+    case Element::Type::Object:
+        c.objects++;
+        c.members += elem->childCount;
+        for (auto it = elem->firstChild; it != nullptr; it = it->next) {
+            c.keys++;
+            CountTree(it->firstChild, c);
+        }
+        break;
+    case Element::Type::Array:
+        c.arrays++;
+        c.items += elem->childCount;
+        elem->IterateArray([&](size_t, Element *e) { CountTree(e, c); });
+        break;
+    case Element::Type::String:
+        c.strings++;
+        break;
+    case Element::Type::Number:
+        c.numbers++;
+        break;
+    default:
+        c.literals++;
+        break;
+    }
+}
+
+TEST(Sax, Events) {
+    for (auto body : {&twitterBody, &canadaBody, &citmBody}) {
+        SaxCounter events;
+        const char *term = nullptr;
+        EXPECT_TRUE(ParseEvents({body->data(), body->size()}, events, &term));
+        EXPECT_EQ(Tokenizer::FwdSpaces(term, body->data() + body->size()),
+                  body->data() + body->size());
+        EXPECT_EQ(events.depth, 0);
+        EXPECT_GT(events.maxDepth, 1);
+
+        ArenaAllocator arena;
+        auto root = arena.CreateElement();
+        EXPECT_TRUE(root->ParseBody({body->data(), body->size()}, arena));
+
+        SaxCounter tree;
+        CountTree(root, tree);
+        EXPECT_EQ(events.objects, tree.objects);
+        EXPECT_EQ(events.keys, tree.keys);
+        EXPECT_EQ(events.members, tree.members);
+        EXPECT_EQ(events.arrays, tree.arrays);
+        EXPECT_EQ(events.items, tree.items);
+        EXPECT_EQ(events.strings, tree.strings);
+        EXPECT_EQ(events.numbers, tree.numbers);
+        EXPECT_EQ(events.literals, tree.literals);
+    }
+}
+
+TEST(Sax, Errors) {
+    SaxCounter c;
+    EXPECT_TRUE(ParseEvents("{\"a\\\\\": [1, -2.5, \"x\\\"\", true]}", c));
+    EXPECT_EQ(c.keys, 1);
+    EXPECT_EQ(c.strings, 1);
+
+    EXPECT_FALSE(ParseEvents("{\"a\": 1", c));
+    EXPECT_FALSE(ParseEvents("{\"a\" 1}", c));
+    EXPECT_FALSE(ParseEvents("[1 2]", c));
+    EXPECT_FALSE(ParseEvents("[1, nul]", c));
+    EXPECT_FALSE(ParseEvents("[1.]", c));
+    EXPECT_FALSE(ParseEvents("\"abc", c));
+
+    // Stop at the first string
+    struct FirstString : SaxHandler {
+        StringView found;
+        bool String(StringView str) {
+            found = str;
+            return false;
+        }
+    } first;
+
+    StringView body = "[1, {\"k\": \"v\"}, \"w\"]";
+    const char *term = nullptr;
+    EXPECT_FALSE(ParseEvents(body, first, &term));
+    EXPECT_EQ(first.found, "v");
+    EXPECT_EQ(term, body.begin + 10); // At the opening quote
+}
+
+TEST(Format, Minify) {
+    std::string body = " { \"a b\" :\t[1, \"x\\\" \\\\\" ,\n{ } ] }\n";
+    std::string out(body.size(), '\0');
+    out.resize(Minify({body.data(), body.size()}, out.data()));
+    EXPECT_EQ(out, "{\"a b\":[1,\"x\\\" \\\\\",{}]}");
+
+    for (auto corpus : {&twitterBody, &canadaBody, &citmBody}) {
+        // The compact writer keeps strings and numbers as they are, so both
+        // have to agree
+        ArenaAllocator arena;
+        auto root = arena.CreateElement();
+        EXPECT_TRUE(root->ParseBody({corpus->data(), corpus->size()}, arena));
+
+        Writer w;
+        EXPECT_TRUE(w.Value(root, arena));
+
+        std::string minified = *corpus;
+        minified.resize(Minify({minified.data(), minified.size()},
+                               minified.data())); // In place
+        EXPECT_EQ(minified, w.View().ToStd());
+    }
+}
+
+TEST(Format, Reindent) {
+    StringView body = "{\"a\":[1,{},[ ]],\"b\":{\"c\":\"{,}\"}}";
+    std::string expected = "{\n"
+                           "  \"a\": [\n"
+                           "    1,\n"
+                           "    {},\n"
+                           "    []\n"
+                           "  ],\n"
+                           "  \"b\": {\n"
+                           "    \"c\": \"{,}\"\n"
+                           "  }\n"
+                           "}";
+
+    // Measure first, then write
+    size_t size = Reindent(body, nullptr, 0);
+    EXPECT_EQ(size, expected.size());
+
+    std::string out(size, '\0');
+    EXPECT_EQ(Reindent(body, out.data(), out.size()), size);
+    EXPECT_EQ(out, expected);
+
+    // A short buffer is filled as far as it goes
+    char partial[8];
+    EXPECT_EQ(Reindent(body, partial, sizeof(partial)), size);
+    EXPECT_EQ(std::string(partial, sizeof(partial)), expected.substr(0, 8));
+
+    // Minify and Reindent undo each other
+    std::string pretty(Reindent({citmBody.data(), citmBody.size()}, nullptr,
+                                0, 4),
+                       '\0');
+    Reindent({citmBody.data(), citmBody.size()}, pretty.data(), pretty.size(),
+             4);
+
+    std::string a(pretty.size(), '\0'), b(citmBody.size(), '\0');
+    a.resize(Minify({pretty.data(), pretty.size()}, a.data()));
+    b.resize(Minify({citmBody.data(), citmBody.size()}, b.data()));
+    EXPECT_EQ(a, b);
+}
+
+TEST(Validate, Corpora) {
+    for (auto body : {&twitterBody, &canadaBody, &citmBody}) {
+        auto res = Validate({body->data(), body->size()});
+        EXPECT_TRUE(res) << res.Message() << " at " << res.offset;
+    }
+
+    EXPECT_TRUE(Validate(" [1, -0.5, \"a\\/b\\u00e9\\ud83d\\ude00\", "
+                         "{\"k\": {}}, [], true, false, null] "));
+
+    // The escapes accepted by Validate parse as well
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+    EXPECT_TRUE(root->ParseBody("\"a\\/b\"", arena));
+    EXPECT_EQ(root->GetString(arena), "a/b");
+}
+
+TEST(Validate, Errors) {
+    struct Case {
+        const char *body;
+        ValidateError error;
+        size_t offset;
+    };
+
+    Case cases[] = {
+        {"", ValidateError::UnexpectedEnd, 0},
+        {"[1, 2", ValidateError::UnexpectedEnd, 5},
+        {"[1 2]", ValidateError::UnexpectedChar, 3},
+        {"[1, 2,]", ValidateError::UnexpectedChar, 6},
+        {"{\"a\" 1}", ValidateError::UnexpectedChar, 5},
+        {"{1: 2}", ValidateError::UnexpectedChar, 1},
+        {"{\"a\": 1]", ValidateError::UnexpectedChar, 7},
+        {"\"abc", ValidateError::InvalidString, 0},
+        {"\"a\tb\"", ValidateError::InvalidString, 2},
+        {"\"long plain text \\x\"", ValidateError::InvalidEscape, 17},
+        {"\"\\u12g4\"", ValidateError::InvalidEscape, 1},
+        {"\"\\ud83d\"", ValidateError::InvalidEscape, 1},
+        {"[1.]", ValidateError::InvalidNumber, 1},
+        {"[tru]", ValidateError::InvalidLiteral, 1},
+        {"{} {}", ValidateError::TrailingChars, 3},
+    };
+
+    for (auto &c : cases) {
+        auto res = Validate(c.body);
+        EXPECT_EQ(res.error, c.error) << c.body;
+        EXPECT_EQ(res.offset, c.offset) << c.body;
+    }
+
+    std::string deep(validateMaxDepth, '[');
+    deep.append(validateMaxDepth, ']');
+    EXPECT_TRUE(Validate({deep.data(), deep.size()}));
+
+    deep = "[" + deep + "]";
+    auto res = Validate({deep.data(), deep.size()});
+    EXPECT_EQ(res.error, ValidateError::TooDeep);
+    EXPECT_EQ(res.offset, validateMaxDepth);
+}
+
+TEST(Bind, Simple) {
+    ArenaAllocator arena;
+    auto body = "{\"skip\": {\"a\": [1, \"}\", {}]}, \"i\\u0064\": 12, "
+                "\"screen_name\": \"a\\nb\", \"extra\": null}";
+
+    BindUser user;
+    EXPECT_TRUE(Parse(body, user, arena));
+    EXPECT_EQ(user.id, 12);
+    EXPECT_EQ(user.screen_name, "a\nb");
+
+    EXPECT_FALSE(Parse("{\"id\": \"12\"}", user, arena));
+    EXPECT_FALSE(Parse("{\"id\": 1.5}", user, arena));
+    EXPECT_FALSE(Parse("{\"id\": 12", user, arena));
+
+    // Only the JSON number grammar is read, and a value that fails to read
+    // leaves its target as it was
+    for (auto body : {"{\"id\": 012}", "{\"id\": +1}", "{\"id\": 1.5}"}) {
+        EXPECT_FALSE(Parse(body, user, arena)) << body;
+        EXPECT_EQ(user.id, 12) << body;
+    }
+
+    BindStatus status;
+    for (auto body : {"{\"favorited\": tru}", "{\"favorited\": 1}",
+                      "{\"favorited\": fals}"}) {
+        EXPECT_FALSE(Parse(body, status, arena)) << body;
+        EXPECT_TRUE(status.favorited) << body;
+    }
+    EXPECT_TRUE(Parse("{\"favorited\": false}", status, arena));
+    EXPECT_FALSE(status.favorited);
+}
+
+TEST(Bind, Twitter) {
+    ArenaAllocator arena;
+    BindTwitter twitter;
+    EXPECT_TRUE(
+        Parse({twitterBody.data(), twitterBody.size()}, twitter, arena));
+    EXPECT_EQ(twitter.statuses.size(), 100);
+
+    auto root = arena.CreateElement();
+    EXPECT_TRUE(
+        root->ParseBody({twitterBody.data(), twitterBody.size()}, arena));
+
+    auto statuses = root->FindChildElement("statuses", arena);
+    EXPECT_TRUE(statuses);
+
+    statuses->IterateArray([&](auto index, Element *status) {
+        auto &bound = twitter.statuses[index];
+
+        uint64_t id;
+        EXPECT_TRUE(status->FindChildElement("id", arena)->GetInteger(id));
+        EXPECT_EQ(bound.id, id);
+        EXPECT_EQ(bound.text,
+                  status->FindChildElement("text", arena)->GetString(arena));
+        EXPECT_FALSE(bound.favorited);
+        EXPECT_GE(bound.retweet_count, 0);
+
+        auto user = status->FindChildElement("user", arena);
+        EXPECT_TRUE(user->FindChildElement("id", arena)->GetInteger(id));
+        EXPECT_EQ(bound.user.id, id);
+    });
+}
+
+TEST(Bind, Canada) {
+    ArenaAllocator arena;
+    BindCanada canada;
+    EXPECT_TRUE(Parse({canadaBody.data(), canadaBody.size()}, canada, arena));
+    EXPECT_EQ(canada.features.size(), 1);
+
+    auto &geometry = canada.features[0].geometry;
+    EXPECT_EQ(geometry.type, "Polygon");
+    EXPECT_EQ(geometry.coordinates.size(), 480);
+    EXPECT_EQ(geometry.coordinates[0][0].size(), 2);
+}
+
+TEST(Snapshot, RoundTrip) {
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+    EXPECT_TRUE(root->ParseBody({citmBody.data(), citmBody.size()}, arena));
+
+    std::string tempDir = path + "/tmp";
+    if (!std::filesystem::is_directory(tempDir)) {
+        std::filesystem::create_directory(tempDir);
+    }
+
+    auto file = tempDir + "/citm_catalog.snapshot";
+    {
+        std::ofstream s(file, std::ios::binary);
+        EXPECT_TRUE(Snapshot::Write(root, arena, s));
+    }
+
+    Snapshot snapshot;
+    EXPECT_TRUE(snapshot.Open(file.c_str()));
+    EXPECT_TRUE(snapshot.Root());
+    EXPECT_TRUE(SameTree(root, snapshot.Root(), arena));
+
+    auto events = snapshot.Root().FindChildElement("events");
+    EXPECT_EQ(events.Type(), Element::Type::Object);
+    EXPECT_EQ(events.ChildCount(),
+              root->FindChildElement("events", arena)->childCount);
+
+    std::filesystem::remove(file);
+}
+
+TEST(Snapshot, Validation) {
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+    auto body = "{\"a\": [1, \"b\", null, 2.5], \"c\": {}}";
+    EXPECT_TRUE(root->ParseBody(body, arena));
+
+    std::ostringstream s;
+    EXPECT_TRUE(Snapshot::Write(root, arena, s));
+
+    // Copy into a buffer with the alignment that a mapping would have
+    auto image = s.str();
+    std::vector<uint64_t> storage(image.size() / 8 + 1);
+    auto buffer = reinterpret_cast<char *>(storage.data());
+    memcpy(buffer, image.data(), image.size());
+
+    Snapshot snapshot;
+    EXPECT_TRUE(snapshot.Load({buffer, image.size()}));
+    auto a = snapshot.Root().FindChildElement("a");
+    EXPECT_EQ(a.GetArrayIndex(1).GetString(), "b");
+
+    int i;
+    EXPECT_TRUE(a.GetArrayIndex(0).GetInteger(i));
+    EXPECT_FALSE(a.GetArrayIndex(3).GetInteger(i));
+
+    EXPECT_FALSE(snapshot.Load({buffer, image.size() - 1}));
+    EXPECT_FALSE(snapshot.Root());
+
+    // Point the root at itself
+    auto nodes = reinterpret_cast<FlatNode *>(buffer + 32);
+    nodes[0].firstChild = 0;
+    EXPECT_FALSE(snapshot.Load({buffer, image.size()}));
+}
+
+static std::string SerializeBody(StringView body) {
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+    EXPECT_TRUE(root->ParseBody(body, arena));
+
+    std::ostringstream s;
+    root->Serialize(arena, s);
+    return s.str();
+}
+
+TEST(MergePatch, RFC7396) {
+    const char *cases[][3] = {
+        {"{\"a\":\"b\"}", "{\"a\":\"c\"}", "{\"a\":\"c\"}"},
+        {"{\"a\":\"b\"}", "{\"b\":\"c\"}", "{\"a\":\"b\",\"b\":\"c\"}"},
+        {"{\"a\":\"b\"}", "{\"a\":null}", "{}"},
+        {"{\"a\":\"b\",\"b\":\"c\"}", "{\"a\":null}", "{\"b\":\"c\"}"},
+        {"{\"a\":[\"b\"]}", "{\"a\":\"c\"}", "{\"a\":\"c\"}"},
+        {"{\"a\":\"c\"}", "{\"a\":[\"b\"]}", "{\"a\":[\"b\"]}"},
+        {"{\"a\":{\"b\":\"c\"}}", "{\"a\":{\"b\":\"d\",\"c\":null}}",
+         "{\"a\":{\"b\":\"d\"}}"},
+        {"{\"a\":[{\"b\":\"c\"}]}", "{\"a\":[1]}", "{\"a\":[1]}"},
+        {"[\"a\",\"b\"]", "[\"c\",\"d\"]", "[\"c\",\"d\"]"},
+        {"{\"a\":\"b\"}", "[\"c\"]", "[\"c\"]"},
+        {"{\"a\":\"foo\"}", "null", "null"},
+        {"{\"a\":\"foo\"}", "\"bar\"", "\"bar\""},
+        {"{\"e\":null}", "{\"a\":1}", "{\"e\":null,\"a\":1}"},
+        {"[1,2]", "{\"a\":\"b\",\"c\":null}", "{\"a\":\"b\"}"},
+        {"{}", "{\"a\":{\"bb\":{\"ccc\":null}}}", "{\"a\":{\"bb\":{}}}"},
+    };
+
+    for (auto &c : cases) {
+        ArenaAllocator arena;
+        auto target = arena.CreateElement();
+        EXPECT_TRUE(target->ParseBody(c[0], arena));
+
+        std::ostringstream s;
+        {
+            ArenaAllocator patchArena;
+            auto patch = patchArena.CreateElement();
+            EXPECT_TRUE(patch->ParseBody(c[1], patchArena));
+            EXPECT_TRUE(target->ApplyMergePatch(patch, arena));
+        }
+
+        target->Serialize(arena, s);
+        EXPECT_EQ(s.str(), SerializeBody(c[2])) << c[0] << " + " << c[1];
+    }
+}
+
+TEST(MergePatch, WideObject) {
+    std::string body = "{";
+    std::string patchBody = "{";
+    std::string expected = "{";
+
+    for (int i = 0; i < 100; ++i) {
+        auto n = std::to_string(i);
+        body += (i ? ", \"k" : "\"k") + n + "\": " + n;
+
+        if (i % 3 == 0) {
+            patchBody += "\"k" + n + "\": null, ";
+        } else if (i % 3 == 1) {
+            patchBody += "\"k" + n + "\": \"v" + n + "\", ";
+            expected += "\"k" + n + "\": \"v" + n + "\", ";
+        } else {
+            expected += "\"k" + n + "\": " + n + ", ";
+        }
+    }
+
+    patchBody += "\"new\": {\"x\": null, \"y\": true}}";
+    expected += "\"new\": {\"y\": true}}";
+    body += "}";
+
+    ArenaAllocator arena;
+    auto target = arena.CreateElement();
+    auto patch = arena.CreateElement();
+    EXPECT_TRUE(target->ParseBody({body.data(), body.size()}, arena));
+    EXPECT_TRUE(patch->ParseBody({patchBody.data(), patchBody.size()}, arena));
+    EXPECT_TRUE(target->ApplyMergePatch(patch, arena));
+    EXPECT_EQ(target->childCount, 67);
+
+    // Appending after the patch must still find the tail of the list
+    auto added = patch->FindChildElement("new", arena);
+    EXPECT_TRUE(target->ObjectAssign("last", added, arena));
+    expected.back() = ',';
+    expected += " \"last\": {\"x\": null, \"y\": true}}";
+
+    std::ostringstream s;
+    target->Serialize(arena, s);
+    EXPECT_EQ(s.str(), SerializeBody({expected.data(), expected.size()}));
+}
+
+TEST(MergePatch, DuplicateKeys) {
+    // Both copies of a are removed, whether the object is small enough to be
+    // scanned or wide enough to be indexed
+    for (int width : {0, 20}) {
+        std::string body = "{\"a\": 1, \"a\": 2";
+        std::string expected = "{";
+        for (int i = 0; i < width; ++i) {
+            auto n = std::to_string(i);
+            body += ", \"k" + n + "\": " + n;
+            expected += (i ? ", \"k" : "\"k") + n + "\": " + n;
+        }
+        body += "}";
+        expected += "}";
+
+        auto patchBody = "{\"a\": null, \"a\": null, \"x\": null, \"y\": null}";
+
+        ArenaAllocator arena;
+        auto target = arena.CreateElement();
+        auto patch = arena.CreateElement();
+        EXPECT_TRUE(target->ParseBody({body.data(), body.size()}, arena));
+        EXPECT_TRUE(patch->ParseBody(patchBody, arena));
+        EXPECT_TRUE(target->ApplyMergePatch(patch, arena));
+        EXPECT_EQ(target->childCount, width);
+
+        std::ostringstream s;
+        target->Serialize(arena, s);
+        EXPECT_EQ(s.str(), SerializeBody({expected.data(), expected.size()}))
+            << width;
+    }
+}
+
+TEST(Clone, Detached) {
+    ArenaAllocator dst;
+    Element *clone = nullptr;
+    std::string expected;
+
+    {
+        std::string body = twitterBody;
+        ArenaAllocator src;
+        auto root = src.CreateElement();
+        EXPECT_TRUE(root->ParseBody({body.data(), body.size()}, src));
+
+        auto statuses = root->FindChildElement("statuses", src);
+        EXPECT_TRUE(statuses);
+
+        std::ostringstream s;
+        statuses->Serialize(src, s);
+        expected = s.str();
+
+        clone = statuses->CloneInto(dst);
+        EXPECT_TRUE(clone);
+
+        // Scribble over the source, the clone must not refer to it
+        std::fill(body.begin(), body.end(), 'x');
+    }
+
+    EXPECT_EQ(clone->type, Element::Type::Array);
+    EXPECT_EQ(clone->childCount, 100);
+    EXPECT_EQ(clone->next, nullptr);
+
+    std::ostringstream s;
+    clone->Serialize(dst, s);
+    EXPECT_EQ(s.str(), expected);
+
+    // The arena must still hand out elements after a batch allocation
+    auto extra = dst.CreateElement();
+    EXPECT_TRUE(extra);
+    EXPECT_TRUE(extra->ParseBody("[1, 2]", dst));
+    EXPECT_TRUE(clone->ArrayPush(extra));
+    EXPECT_EQ(clone->GetArrayIndex(100), extra);
+}
+
+TEST(Hash, XXH64) {
+    EXPECT_EQ(Hash64(""), 0xEF46DB3751D8E999ull);
+    EXPECT_EQ(Hash64("a"), 0xD24EC4F1A98C6E5Bull);
+    EXPECT_EQ(Hash64("abc"), 0x44BC2CF5AD770999ull);
+
+    // Long inputs go through the striped loop, and must see every byte
+    std::string body = twitterBody;
+    auto h = Hash64({body.data(), body.size()});
+    EXPECT_EQ(h, Hash64({twitterBody.data(), twitterBody.size()}));
+    body[body.size() / 2] ^= 1;
+    EXPECT_NE(h, Hash64({body.data(), body.size()}));
+    EXPECT_NE(h, Hash64({twitterBody.data(), twitterBody.size()}, 1));
+}
+
+TEST(ParseCache, Hits) {
+    ParseCache cache(64 * 1024 * 1024);
+
+    // A copy at another address still hits
+    std::string copy = twitterBody;
+    auto first = cache.Parse({twitterBody.data(), twitterBody.size()});
+    auto second = cache.Parse({copy.data(), copy.size()});
+    EXPECT_EQ(first->type, Element::Type::Object);
+    EXPECT_EQ(first.get(), second.get());
+    EXPECT_EQ(cache.Hits(), 1);
+    EXPECT_EQ(cache.Misses(), 1);
+    EXPECT_EQ(cache.Count(), 1);
+    EXPECT_GT(cache.Bytes(), twitterBody.size());
+
+    // The tree must not refer to the text it was parsed from
+    std::fill(copy.begin(), copy.end(), 'x');
+    EXPECT_EQ(first->firstChild->ref, StringView("statuses"));
+
+    auto other = cache.Parse("[1, 2, 3]");
+    EXPECT_NE(other.get(), first.get());
+    EXPECT_EQ(other->childCount, 3);
+
+    // Errors are returned, but not cached
+    auto bad = cache.Parse("[1, 2");
+    EXPECT_EQ(bad->type, Element::Type::Error);
+    EXPECT_EQ(cache.Count(), 2);
+}
+
+TEST(ParseCache, Eviction) {
+    ParseCache cache(64 * 1024 * 1024);
+
+    auto twitter = cache.Parse({twitterBody.data(), twitterBody.size()});
+    auto citm = cache.Parse({citmBody.data(), citmBody.size()});
+    size_t both = cache.Bytes();
+    EXPECT_EQ(cache.Count(), 2);
+
+    // Using twitter again makes citm the least recently used
+    cache.Parse({twitterBody.data(), twitterBody.size()});
+    cache.SetBudget(both - 1);
+    EXPECT_EQ(cache.Count(), 1);
+    EXPECT_LT(cache.Bytes(), both);
+
+    auto again = cache.Parse({twitterBody.data(), twitterBody.size()});
+    EXPECT_EQ(again.get(), twitter.get());
+
+    // Evicted roots stay usable
+    EXPECT_EQ(citm->type, Element::Type::Object);
+    auto copy = cache.Parse({citmBody.data(), citmBody.size()});
+    EXPECT_NE(copy.get(), citm.get());
+
+    // Too large to ever fit, so it is returned without being kept
+    cache.SetBudget(1024);
+    EXPECT_EQ(cache.Count(), 0);
+    EXPECT_EQ(cache.Bytes(), 0);
+    auto uncached = cache.Parse({canadaBody.data(), canadaBody.size()});
+    EXPECT_EQ(uncached->type, Element::Type::Object);
+    EXPECT_EQ(cache.Count(), 0);
+
+    cache.SetBudget(64 * 1024 * 1024);
+    cache.Parse("{}");
+    cache.Clear();
+    EXPECT_EQ(cache.Count(), 0);
+    EXPECT_EQ(cache.Bytes(), 0);
+}
+
+static std::string SerializeRoot(Element *root, ArenaAllocator &arena) {
+    std::ostringstream s;
+    EXPECT_TRUE(root->Serialize(arena, s));
+    return s.str();
+}
+
+TEST(Incremental, Edits) {
+    ArenaAllocator arena;
+    EditableDocument doc;
+    EXPECT_TRUE(doc.Parse({twitterBody.data(), twitterBody.size()}, arena));
+
+    auto apply = [&](size_t offset, size_t removed, StringView inserted) {
+        bool ok = doc.ApplyEdit({offset, removed, inserted}, arena);
+        auto src = doc.Source();
+        std::string text(src.begin, src.Size());
+        if (ok) {
+            EXPECT_EQ(SerializeRoot(doc.Root(), arena),
+                      SerializeBody({text.data(), text.size()}));
+        }
+        return ok;
+    };
+
+    auto statuses = doc.Root()->FindChildElement("statuses", arena);
+    auto meta =
+        statuses->GetArrayIndex(50)->FindChildElement("metadata", arena);
+    auto type = meta->FindChildElement("result_type", arena);
+    EXPECT_EQ(type->ref, "recent");
+
+    // Shrinking keeps the buffer, so only what follows the edit moves
+    auto src = doc.Source();
+    size_t at = static_cast<size_t>(type->ref.begin - src.begin);
+    EXPECT_TRUE(apply(at, 6, "old"));
+    EXPECT_LT(doc.LastReparsedSize(), 100);
+    EXPECT_EQ(doc.Source().begin, src.begin);
+
+    // Growing reallocates the buffer, so everything moves
+    EXPECT_TRUE(apply(at, 3, "much older than before"));
+    EXPECT_LT(doc.LastReparsedSize(), 100);
+
+    type = meta->FindChildElement("result_type", arena);
+    EXPECT_EQ(type->GetString(arena), "much older than before");
+    auto meta2 = statuses->GetArrayIndex(51)->FindChildElement("metadata",
+                                                               arena);
+    EXPECT_EQ(meta2->FindChildElement("result_type", arena)->ref, "recent");
+
+    // Adding a member, the enclosing object is reparsed
+    src = doc.Source();
+    at = static_cast<size_t>(meta->ref.begin - src.begin) + 1;
+    EXPECT_TRUE(apply(at, 0, "\"new\": [1, {\"x\": 2}], "));
+    EXPECT_EQ(meta->childCount, 3);
+    EXPECT_LT(doc.LastReparsedSize(), 200);
+
+    // Closing the object early changes its span, so a larger container is
+    // parsed instead
+    src = doc.Source();
+    at = static_cast<size_t>(meta->ref.begin - src.begin) + 1;
+    EXPECT_TRUE(apply(at, 0, "}, \"m\": {"));
+    EXPECT_GT(doc.LastReparsedSize(), 200);
+
+    // Broken edits fail, and the next one parses everything again. The
+    // status was replaced, so its nodes have to be looked up again.
+    meta = statuses->GetArrayIndex(50)->FindChildElement("m", arena);
+    src = doc.Source();
+    at = static_cast<size_t>(meta->ref.begin - src.begin) + 1;
+    EXPECT_FALSE(apply(at, 0, "{"));
+    EXPECT_EQ(doc.Root()->type, Element::Type::Error);
+    EXPECT_TRUE(apply(at, 1, ""));
+    EXPECT_EQ(doc.LastReparsedSize(), doc.Source().Size());
+
+    EXPECT_FALSE(doc.ApplyEdit({doc.Source().Size() + 1, 0, ""}, arena));
+    EXPECT_FALSE(doc.ApplyEdit({0, doc.Source().Size() + 1, ""}, arena));
+}
+
+// Reads only through the const API, so it is safe on frozen trees
+static uint64_t SumStatuses(const Element *root) {
+    uint64_t sum = 0;
+    auto statuses = root->FindChildElement("statuses");
+
+    statuses->IterateArray([&](size_t, const Element *status) {
+        int64_t id = 0;
+        EXPECT_TRUE(status->FindChildElement("id")->GetInteger(id));
+        sum += static_cast<uint64_t>(id);
+
+        auto user = status->FindChildElement("user");
+        sum += user->FindChildElement("screen_name")->GetString().Size();
+        sum += status->FindChildElement("text")->GetEscapedString().Size();
+
+        status->IterateObject([&](StringView key, const Element *value) {
+            sum += key.Size() + static_cast<int>(value->type);
+        });
+    });
+
+    return sum;
+}
+
+TEST(Freeze, ConcurrentReads) {
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+    EXPECT_TRUE(
+        root->ParseBody({twitterBody.data(), twitterBody.size()}, arena));
+
+    // A string that only has its unescaped version until frozen
+    auto status = root->FindChildElement("statuses", arena)->GetArrayIndex(3);
+    status->FindChildElement("text", arena)->SetString("a\"b");
+    EXPECT_TRUE(root->Freeze(arena));
+
+    const Element *frozen = root;
+    auto text = frozen->FindChildElement("statuses")
+                    ->GetArrayIndex(3)
+                    ->FindChildElement("text");
+    EXPECT_EQ(text->GetString(), "a\"b");
+    EXPECT_EQ(text->GetEscapedString(), "a\\\"b");
+    EXPECT_EQ(frozen->FindChildElement("statuses")
+                  ->GetArrayIndex(0)
+                  ->FindChildElement("id")
+                  ->decoded,
+              Element::Decoded::Integer);
+    EXPECT_FALSE(frozen->FindChildElement("missing"));
+    EXPECT_FALSE(frozen->GetArrayIndex(0));
+
+    uint64_t expected = SumStatuses(frozen);
+    std::vector<uint64_t> sums(4);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < sums.size(); ++i) {
+        threads.emplace_back([&, i] {
+            for (int n = 0; n < 20; ++n) {
+                sums[i] = SumStatuses(frozen);
+            }
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (auto sum : sums) {
+        EXPECT_EQ(sum, expected);
+    }
+
+    // Cached documents come back frozen
+    ParseCache cache(64 * 1024 * 1024);
+    auto cached = cache.Parse({twitterBody.data(), twitterBody.size()});
+    EXPECT_EQ(cached->FindChildElement("statuses")->childCount, 100);
+
+    EXPECT_FALSE(root->ParseBody("[1, ", arena));
+    EXPECT_FALSE(root->Freeze(arena));
+}
+
 TEST(Parsing, BigThree) {
     ArenaAllocator allocator;
     auto twitter = allocator.CreateElement();
@@ -180,6 +1514,23 @@ TEST(Parsing, BigThree) {
     EXPECT_NE(citm->type, Element::Type::Error);
 }
 
+TEST(Parsing, MappedFile) {
+    ArenaAllocator arena;
+    Document doc;
+    EXPECT_TRUE(doc.ParseFile((path + "/tmp/canada.json").c_str(), arena));
+    EXPECT_EQ(doc.Source().Size(), canadaBody.size());
+    EXPECT_EQ(doc.Root()->type, Element::Type::Object);
+
+    auto features = doc.Root()->FindChildElement("features", arena);
+    EXPECT_TRUE(features);
+    EXPECT_EQ(features->childCount, 1);
+
+    Document missing;
+    auto missingPath = path + "/tmp/missing.json";
+    EXPECT_FALSE(missing.ParseFile(missingPath.c_str(), arena));
+    EXPECT_EQ(missing.Root()->type, Element::Type::Error);
+}
+
 TEST(Parsing, BigDocMalformedNumber) {
     auto body = ReadFile("/samples/test2_malformed_number.json");
 
@@ -219,6 +1570,294 @@ TEST(Parsing, MultiLine) {
     }
 }
 
+TEST(Shape, Records) {
+    ArenaAllocator arena;
+    Shape shape;
+    ParseOptions options;
+    options.shape = &shape;
+
+    auto body = ReadFile("/tmp/one-json-per-line.jsons");
+    std::string line;
+    std::istringstream s(body);
+    size_t lines = 0;
+    while (std::getline(s, line)) {
+        auto root = arena.CreateElement();
+        EXPECT_TRUE(root->ParseBody({line.data(), line.size()}, arena,
+                                    options));
+        EXPECT_EQ(SerializeRoot(root, arena),
+                  SerializeBody({line.data(), line.size()}));
+        arena.Reset();
+        lines++;
+    }
+
+    // The stream alternates between a few schemas
+    EXPECT_GT(shape.Hits(), 2 * shape.Misses());
+
+    // Statuses have different keys, but the result must not depend on that
+    auto root = arena.CreateElement();
+    for (int i = 0; i < 2; ++i) {
+        EXPECT_TRUE(root->ParseBody({twitterBody.data(), twitterBody.size()},
+                                    arena, options));
+        EXPECT_EQ(SerializeRoot(root, arena),
+                  SerializeBody({twitterBody.data(), twitterBody.size()}));
+    }
+
+    // Keys that only share a prefix, escaped keys, and objects that end
+    // early or go on longer than the learned ones
+    shape.Clear();
+    std::pair<const char *, bool> docs[] = {
+        {"{\"ab\": 1, \"\\u0063\": {\"x\": 2}}", true},
+        {"{\"ab\": 1, \"\\u0063\": {\"x\": 3}}", true},
+        {"{\"abc\": 1, \"\\u0063\": {\"x\": 4}}", true},
+        {"{\"abc\": 1}", false},
+        {"{\"abc\": 1, \"c\": 5, \"d\": 6}", true},
+        {"{\"abc\": 1, \"c\": 7, \"d\": 8}", true},
+        {"{\"ab\": 1, \"\\u0063\": {\"x\": 9}}", true},
+    };
+    for (auto [doc, hasC] : docs) {
+        EXPECT_TRUE(root->ParseBody(doc, arena, options));
+        EXPECT_EQ(SerializeRoot(root, arena), SerializeBody(doc));
+        EXPECT_EQ(root->FindChildElement("c", arena) != nullptr, hasC);
+    }
+
+    // The order starting with "ab" is kept while the others are learned, so
+    // the last document matches along with the object below \u0063. The
+    // object that ends early matches the start of the order before it.
+    EXPECT_EQ(shape.Hits(), 5);
+    EXPECT_EQ(shape.Misses(), 4);
+
+    // Records with an optional key in the middle learn an order each
+    shape.Clear();
+    for (int i = 0; i < 6; ++i) {
+        auto doc = i % 2 ? "{\"a\": 1, \"b\": 2, \"c\": 3}"
+                         : "{\"a\": 1, \"c\": 3}";
+        EXPECT_TRUE(root->ParseBody(doc, arena, options));
+        EXPECT_EQ(SerializeRoot(root, arena), SerializeBody(doc));
+    }
+    EXPECT_EQ(shape.Hits(), 4);
+    EXPECT_EQ(shape.Misses(), 2);
+
+    EXPECT_FALSE(root->ParseBody("{\"abc\": 1, \"c\" 7}", arena, options));
+    EXPECT_FALSE(root->ParseBody("{\"abc\"", arena, options));
+}
+
+static std::string Bytes(std::initializer_list<int> bytes) {
+    std::string s;
+    for (int b : bytes) {
+        s += static_cast<char>(b);
+    }
+    return s;
+}
+
+TEST(Binary, Encodings) {
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+
+    auto doc = "{\"a\": [0, -1, 300, -200, 1.5, 0.1, true, false, null, "
+               "\"x\"]}";
+    EXPECT_TRUE(root->ParseBody(doc, arena));
+
+    auto msgpack = Bytes({0x81, 0xa1, 0x61, 0x9a, 0x00, 0xff, 0xcd, 0x01,
+                          0x2c, 0xd1, 0xff, 0x38, 0xca, 0x3f, 0xc0, 0x00,
+                          0x00, 0xcb, 0x3f, 0xb9, 0x99, 0x99, 0x99, 0x99,
+                          0x99, 0x9a, 0xc3, 0xc2, 0xc0, 0xa1, 0x78});
+    auto cbor = Bytes({0xa1, 0x61, 0x61, 0x8a, 0x00, 0x20, 0x19, 0x01,
+                       0x2c, 0x38, 0xc7, 0xfa, 0x3f, 0xc0, 0x00, 0x00,
+                       0xfb, 0x3f, 0xb9, 0x99, 0x99, 0x99, 0x99, 0x99,
+                       0x9a, 0xf5, 0xf4, 0xf6, 0x61, 0x78});
+
+    std::string out;
+    EXPECT_TRUE(root->ToMessagePack(arena, out));
+    EXPECT_EQ(out, msgpack);
+
+    out.clear();
+    EXPECT_TRUE(root->ToCBOR(arena, out));
+    EXPECT_EQ(out, cbor);
+
+    out.clear();
+    EXPECT_TRUE(MessagePackToCBOR({msgpack.data(), msgpack.size()}, out));
+    EXPECT_EQ(out, cbor);
+
+    out.clear();
+    EXPECT_TRUE(CBORToMessagePack({cbor.data(), cbor.size()}, out));
+    EXPECT_EQ(out, msgpack);
+
+    const char *term = nullptr;
+    EXPECT_TRUE(
+        root->ParseMessagePack({msgpack.data(), msgpack.size()}, arena, &term));
+    EXPECT_EQ(term, msgpack.data() + msgpack.size());
+    EXPECT_EQ(SerializeRoot(root, arena), SerializeBody(doc));
+
+    EXPECT_TRUE(root->ParseCBOR({cbor.data(), cbor.size()}, arena, &term));
+    EXPECT_EQ(term, cbor.data() + cbor.size());
+    EXPECT_EQ(SerializeRoot(root, arena), SerializeBody(doc));
+
+    // Integers at both ends of 64 bits
+    auto ends = "[18446744073709551615, -9223372036854775808]";
+    EXPECT_TRUE(root->ParseBody(ends, arena));
+
+    out.clear();
+    EXPECT_TRUE(root->ToCBOR(arena, out));
+    EXPECT_EQ(out, Bytes({0x82, 0x1b, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                          0xff, 0xff, 0x3b, 0x7f, 0xff, 0xff, 0xff, 0xff,
+                          0xff, 0xff, 0xff}));
+    EXPECT_TRUE(root->ParseCBOR({out.data(), out.size()}, arena));
+    EXPECT_EQ(SerializeRoot(root, arena), SerializeBody(ends));
+
+    out.clear();
+    EXPECT_TRUE(root->ToMessagePack(arena, out));
+    EXPECT_TRUE(root->ParseMessagePack({out.data(), out.size()}, arena));
+    EXPECT_EQ(SerializeRoot(root, arena), SerializeBody(ends));
+
+    // CBOR containers and strings of indefinite length, a tag and a half
+    // float
+    auto indefinite = Bytes({0x9f, 0x7f, 0x62, 'a', 'b', 0x61, 'c', 0xff,
+                             0xc1, 0x01, 0xf9, 0x3c, 0x00, 0xbf, 0x61, 'k',
+                             0xf6, 0xff, 0xff});
+    EXPECT_TRUE(
+        root->ParseCBOR({indefinite.data(), indefinite.size()}, arena));
+    EXPECT_EQ(SerializeRoot(root, arena),
+              SerializeBody("[\"abc\", 1, 1, {\"k\": null}]"));
+
+    std::string viaTree;
+    EXPECT_TRUE(root->ToMessagePack(arena, viaTree));
+
+    out.clear();
+    EXPECT_TRUE(
+        CBORToMessagePack({indefinite.data(), indefinite.size()}, out));
+    EXPECT_EQ(out, viaTree);
+}
+
+TEST(Binary, Errors) {
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+
+    auto fails = [&](const std::string &body, bool cbor, const char *error) {
+        StringView view{body.data(), body.size()};
+        std::string out;
+
+        bool ok = cbor ? root->ParseCBOR(view, arena)
+                       : root->ParseMessagePack(view, arena);
+        EXPECT_FALSE(ok);
+        EXPECT_EQ(root->type, Element::Type::Error);
+        EXPECT_EQ(root->ref, error);
+
+        EXPECT_FALSE(cbor ? CBORToMessagePack(view, out)
+                          : MessagePackToCBOR(view, out));
+    };
+
+    fails(Bytes({0x91, 0xc4, 0x01, 0x00}), false,
+          "Binary data has no JSON equivalent");
+    fails(Bytes({0x81, 0x01, 0x02}), false, "Object keys must be strings");
+    fails(Bytes({0x92, 0x01}), false,
+          "End of input reached before end of value");
+    fails(Bytes({0xa3, 'a'}), false,
+          "End of input reached before end of string");
+    fails(Bytes({0xc1}), false, "Invalid type byte");
+    fails(Bytes({0xfb, 0x7f, 0xf8, 0, 0, 0, 0, 0, 0}), true,
+          "Number has no JSON equivalent");
+    fails(Bytes({0x9f, 0x01}), true,
+          "End of input reached before end of value");
+    fails(Bytes({0xff}), true, "Break outside of a container");
+    fails(Bytes({0xf7}), true, "Simple value has no JSON equivalent");
+
+    std::string deep(binaryMaxDepth + 1, '\x91');
+    deep += '\x01';
+    fails(deep, false, "Containers nested too deep");
+
+    // Elements that are not values can't be written
+    std::string out;
+    root->type = Element::Type::Error;
+    EXPECT_FALSE(root->ToMessagePack(arena, out));
+}
+
+TEST(Binary, Corpora) {
+    for (auto body : {&twitterBody, &canadaBody, &citmBody}) {
+        ArenaAllocator arena;
+        auto root = arena.CreateElement();
+        EXPECT_TRUE(root->ParseBody({body->data(), body->size()}, arena));
+
+        std::string msgpack;
+        std::string cbor;
+        EXPECT_TRUE(root->ToMessagePack(arena, msgpack));
+        EXPECT_TRUE(root->ToCBOR(arena, cbor));
+        EXPECT_LT(msgpack.size(), body->size());
+
+        // Both formats read back to trees that write the same bytes
+        auto copy = arena.CreateElement();
+        EXPECT_TRUE(
+            copy->ParseMessagePack({msgpack.data(), msgpack.size()}, arena));
+        std::string again;
+        EXPECT_TRUE(copy->ToCBOR(arena, again));
+        EXPECT_EQ(again, cbor);
+
+        EXPECT_TRUE(copy->ParseCBOR({cbor.data(), cbor.size()}, arena));
+        again.clear();
+        EXPECT_TRUE(copy->ToMessagePack(arena, again));
+        EXPECT_EQ(again, msgpack);
+
+        again.clear();
+        EXPECT_TRUE(MessagePackToCBOR({msgpack.data(), msgpack.size()}, again));
+        EXPECT_EQ(again, cbor);
+
+        again.clear();
+        EXPECT_TRUE(CBORToMessagePack({cbor.data(), cbor.size()}, again));
+        EXPECT_EQ(again, msgpack);
+    }
+}
+
+static constexpr char embeddedText[] = R"({
+    "name": "stupid-json",
+    "escaped": "tab\there \"quoted\" \u00e9 \ud83d\ude00",
+    "ports": [80, 443, 8080],
+    "ratio": -0.5e-3,
+    "nested": {"on": true, "off": false, "none": null, "empty": {}},
+    "list": [[], [1], {"a": [2, 3]}]
+})";
+
+STUPID_JSON_EMBED(embeddedConfig, embeddedText);
+
+// Both checked by the compiler, the table is complete before main runs
+static_assert(sizeof(embeddedConfig.nodes) / sizeof(FlatNode) == 32,
+              "Every value and key has a node");
+static_assert(embeddedConfig.nodes[0].type ==
+                  static_cast<uint32_t>(Element::Type::Object),
+              "The root is the first node");
+
+TEST(Embedded, Traversal) {
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+    EXPECT_TRUE(root->ParseBody(embeddedText, arena));
+
+    auto config = embeddedConfig.Root();
+    EXPECT_TRUE(SameTree(root, config, arena));
+
+    int port;
+    EXPECT_TRUE(config.FindChildElement("ports").GetArrayIndex(1).GetInteger(
+        port));
+    EXPECT_EQ(port, 443);
+
+    double ratio;
+    EXPECT_TRUE(config.FindChildElement("ratio").GetFloatingPoint(ratio));
+    EXPECT_EQ(ratio, -0.5e-3);
+
+    EXPECT_EQ(config.FindChildElement("escaped").GetString(),
+              "tab\there \"quoted\" \xc3\xa9 \xf0\x9f\x98\x80");
+
+    size_t keys = 0;
+    config.FindChildElement("nested").IterateObject(
+        [&](StringView, FlatElement) { keys++; });
+    EXPECT_EQ(keys, 4);
+    EXPECT_EQ(config.FindChildElement("list").GetArrayIndex(0).ChildCount(),
+              0);
+    EXPECT_FALSE(config.FindChildElement("missing"));
+
+    STUPID_JSON_EMBED(scalar, " 42 ");
+    int answer;
+    EXPECT_TRUE(scalar.Root().GetInteger(answer));
+    EXPECT_EQ(answer, 42);
+}
+
 TEST(Malformed, NumberPlus) {
     ArenaAllocator arena;
     auto body_valid = "{\"a\": -4 }";
@@ -282,6 +1921,116 @@ TEST(STLTypes, Map) {
     EXPECT_EQ(vec["b"]->ref, "2");
 }
 
+TEST(STLTypes, ArenaSpan) {
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+    EXPECT_TRUE(root->ParseBody("[1, 2, 3, 6, 7, 8]", arena));
+
+    auto span = root->GetChildrenAsSpan(arena);
+    EXPECT_EQ(span.Size(), 6);
+    EXPECT_EQ(span[2]->ref, "3");
+    EXPECT_EQ(span[5], root->lastChild);
+
+    size_t count = 0;
+    for (auto e : span) {
+        count += e->type == Element::Type::Number;
+    }
+    EXPECT_EQ(count, 6);
+
+    EXPECT_TRUE(root->ParseBody("{\"a\": 1}", arena));
+    EXPECT_TRUE(root->GetChildrenAsSpan(arena).Empty());
+
+    // Alignment holds whatever the write head was left at
+    for (size_t align : {1, 2, 8, 16, 64, 4096}) {
+        arena.AllocateString(3);
+        auto p = reinterpret_cast<uintptr_t>(arena.Allocate(24, align));
+        EXPECT_EQ(p % align, 0);
+    }
+}
+
+TEST(STLTypes, ObjectMap) {
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+    EXPECT_TRUE(root->ParseBody(
+        "{\"a\": 1, \"b\": 2, \"\\u0063\": 3, \"a\": 4}", arena));
+
+    auto map = root->GetObjectAsFlatMap(arena);
+    EXPECT_EQ(map.Size(), 3);
+    EXPECT_EQ(map.Find("a")->ref, "4");
+    EXPECT_EQ(map.Find("b")->ref, "2");
+    EXPECT_EQ(map.Find("c")->ref, "3");
+    EXPECT_FALSE(map.Contains("d"));
+    EXPECT_FALSE(map.Contains(""));
+
+    // Matches the heap map on every object of a real document
+    auto twitter = arena.CreateElement();
+    EXPECT_TRUE(
+        twitter->ParseBody({twitterBody.data(), twitterBody.size()}, arena));
+    auto statuses = twitter->FindChildElement("statuses", arena);
+
+    size_t objects = 0;
+    statuses->IterateArray([&](size_t, Element *status) {
+        auto heap = status->GetObjectAsMap(arena);
+        auto flat = status->GetObjectAsFlatMap(arena);
+        EXPECT_EQ(flat.Size(), heap.size());
+
+        for (auto &[key, value] : heap) {
+            EXPECT_EQ(flat.Find({key.data(), key.size()}), value);
+        }
+
+        size_t visited = 0;
+        flat.ForEach([&](StringView key, Element *value) {
+            EXPECT_EQ(heap[key.ToStd()], value);
+            visited++;
+        });
+        EXPECT_EQ(visited, heap.size());
+        objects++;
+    });
+    EXPECT_EQ(objects, 100);
+
+    EXPECT_TRUE(statuses->GetObjectAsFlatMap(arena).Empty());
+    EXPECT_TRUE(root->ParseBody("{}", arena));
+    EXPECT_FALSE(root->GetObjectAsFlatMap(arena).Find("a"));
+}
+
+TEST(STLTypes, ObjectMapThenStrings) {
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+
+    // The escaped member puts a string block behind the one of the map
+    std::string body = "{\"s\": \"\\n\"";
+    for (int i = 0; i < 600; ++i) {
+        body += ", \"k" + std::to_string(i) + "\": 0";
+    }
+    body += "}";
+    EXPECT_TRUE(root->ParseBody({body.data(), body.size()}, arena));
+    EXPECT_EQ(root->FindChildElement("s", arena)->GetString(arena), "\n");
+    auto map = root->GetObjectAsFlatMap(arena);
+    EXPECT_EQ(map.Size(), 601);
+
+    // The long string only fits in the block behind the map, and gives back
+    // the bytes its escapes did not use. Only that block may shrink, or the
+    // next string is written over the slots of the map.
+    std::string text = "[\"";
+    for (int i = 0; i < 40; ++i) {
+        text += "\\u0041";
+    }
+    text += "\", \"" + std::string(40, 'b') + "\\t\"]";
+    auto other = arena.CreateElement();
+    EXPECT_TRUE(other->ParseBody({text.data(), text.size()}, arena));
+    EXPECT_EQ(other->GetArrayIndex(0)->GetString(arena).ToStd(),
+              std::string(40, 'A'));
+    EXPECT_EQ(other->GetArrayIndex(1)->GetString(arena).ToStd(),
+              std::string(40, 'b') + "\t");
+
+    size_t visited = 0;
+    map.ForEach([&](StringView key, Element *value) {
+        EXPECT_EQ(root->FindChildElement(key, arena), value);
+        visited++;
+    });
+    EXPECT_EQ(visited, 601);
+}
+
 TEST(Serialize, Simple) {
     // auto body = ReadFile("/samples/test2.json");
     auto &body = citmBody;
@@ -328,6 +2077,129 @@ TEST(Serialize, ToFile) {
 }
 #endif
 
+TEST(Serialize, ToFd) {
+    for (auto body : {&twitterBody, &citmBody, &canadaBody}) {
+        ArenaAllocator arena;
+        auto root = arena.CreateElement();
+        EXPECT_TRUE(root->ParseBody({body->data(), body->size()}, arena));
+
+        // Escaped and unescaped strings have to come out the same
+        auto statuses = root->FindChildElement("statuses", arena);
+        if (statuses) {
+            auto status = statuses->firstChild;
+            status->FindChildElement("text", arena)->SetString("a\"b\n");
+        }
+
+        std::ostringstream expected;
+        EXPECT_TRUE(root->Serialize(arena, expected));
+
+        FILE *f = tmpfile();
+        ASSERT_TRUE(f);
+        EXPECT_TRUE(SerializeToFd(root, arena, fileno(f)));
+
+        std::string written(expected.str().size() + 1, '\0');
+        rewind(f);
+        written.resize(fread(written.data(), 1, written.size(), f));
+        fclose(f);
+
+        EXPECT_EQ(written, expected.str());
+    }
+
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+    EXPECT_TRUE(root->ParseBody("{\"a\": [], \"b\": {}}", arena));
+    EXPECT_FALSE(SerializeToFd(root, arena, -1));
+}
+
+TEST(Serialize, Parallel) {
+    // A document large enough to be split on several levels, with strings
+    // that only have their unescaped version
+    std::string body = "[";
+    for (int i = 0; i < 6; ++i) {
+        body += i ? ", " : "";
+        body += twitterBody + ", " + citmBody + ", []";
+    }
+    body += ", {}]";
+
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+    EXPECT_TRUE(root->ParseBody({body.data(), body.size()}, arena));
+    auto status = root->firstChild->FindChildElement("statuses", arena);
+    status->firstChild->FindChildElement("text", arena)->SetString("a\"b");
+
+    std::ostringstream expected;
+    EXPECT_TRUE(root->Serialize(arena, expected));
+
+    for (unsigned threads : {1, 2, 3, 8}) {
+        std::ostringstream s;
+        EXPECT_TRUE(SerializeParallel(root, s, threads));
+        EXPECT_TRUE(s.str() == expected.str());
+    }
+
+    for (auto doc : {&twitterBody, &canadaBody}) {
+        EXPECT_TRUE(root->ParseBody({doc->data(), doc->size()}, arena));
+        std::ostringstream a, b;
+        EXPECT_TRUE(root->Serialize(arena, a));
+        EXPECT_TRUE(SerializeParallel(root, b, 4));
+        EXPECT_TRUE(a.str() == b.str());
+    }
+
+    EXPECT_TRUE(root->ParseBody("{\"a\": [], \"b\": {}}", arena));
+    root->firstChild->firstChild = nullptr;
+    std::ostringstream s;
+    EXPECT_FALSE(SerializeParallel(root, s));
+}
+
+#ifdef STUPID_JSON_TRACE
+static struct {
+    int parses = 0;
+    int depth = 0;
+    int maxDepth = 0;
+    int blocks = 0;
+    int unescapes = 0;
+    int findKeys = 0;
+} traceCounts;
+
+void Trace::ParseBegin(const Element *, const char *, const char *) {
+    traceCounts.parses++;
+}
+
+void Trace::ParseEnd(const Element *, bool) {}
+
+void Trace::ContainerEnter(const Element *, const char *) {
+    traceCounts.maxDepth = std::max(++traceCounts.depth, traceCounts.maxDepth);
+}
+
+void Trace::ContainerExit(const Element *, bool) { traceCounts.depth--; }
+
+void Trace::BlockAllocated(const ArenaAllocator *, size_t) {
+    traceCounts.blocks++;
+}
+
+void Trace::Unescape(const char *, const char *) { traceCounts.unescapes++; }
+
+void Trace::FindKey(const Element *, const char *, const char *) {
+    traceCounts.findKeys++;
+}
+
+TEST(Trace, Hooks) {
+    traceCounts = {};
+
+    ArenaAllocator arena;
+    auto root = arena.CreateElement();
+    auto body = "{\"a\": [[1], {\"b\\n\": 2}]}";
+    EXPECT_TRUE(root->ParseBody(body, arena));
+    EXPECT_TRUE(root->FindChildElement("a", arena));
+
+    EXPECT_EQ(traceCounts.parses, 1);
+    EXPECT_EQ(traceCounts.depth, 0);
+    EXPECT_EQ(traceCounts.maxDepth, 3);
+    EXPECT_EQ(traceCounts.blocks, 2);
+    EXPECT_EQ(traceCounts.unescapes, 1);
+    EXPECT_EQ(traceCounts.findKeys, 1);
+}
+#endif
+
 int main(int argc, char **argv) {
     if (argc == 3) {
         path = argv[2];